@@ -1,4 +1,4 @@
-from .sam import __grplasso
+from .sam import __grplasso, __grplasso_array, __bspline_knots, __bspline_basis, __bspline_banded, __bspline_binned, __grplasso_path, __group_transform, __aligned_design, __cv_grplasso, __cv_grplasso_halving
 from .sam import *
 from . import hello
-from .proc import grplasso
+from .proc import grplasso, grplasso_path, cv_grplasso, group_transform, aligned_design, bspline_knots, bspline_basis, bspline_banded, bspline_binned
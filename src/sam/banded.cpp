@@ -0,0 +1,85 @@
+#include "banded.h"
+#include "basis.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SAM {
+  template <class T>
+  BandedDesignT<T>::BandedDesignT(int n, int d, int p, int width)
+    : n(n), d(d), p(p), width(width), first((size_t)n * d), values((size_t)n * d * width) {}
+
+  template <class T>
+  void BandedDesignT<T>::xtr(int j, const double* r, double* out) const {
+    const int* f = &first[(size_t)j * n];
+    const T* v = &values[(size_t)j * n * width];
+    std::fill(out, out + p, 0.0);
+    for (int i = 0; i < n; i++, v += width) {
+      double* o = out + f[i];
+      for (int s = 0; s < width; s++)
+        o[s] += (double)v[s] * r[i];
+    }
+  }
+
+  template <class T>
+  void BandedDesignT<T>::axpy(int j, const double* delta, double* r) const {
+    const int* f = &first[(size_t)j * n];
+    const T* v = &values[(size_t)j * n * width];
+    for (int i = 0; i < n; i++, v += width) {
+      const double* dl = delta + f[i];
+      double acc = 0;
+      for (int s = 0; s < width; s++)
+        acc += (double)v[s] * dl[s];
+      r[i] -= acc;
+    }
+  }
+
+  template <class T>
+  void BandedDesignT<T>::gram(int j, double* out) const {
+    const int* f = &first[(size_t)j * n];
+    const T* v = &values[(size_t)j * n * width];
+    std::fill(out, out + p * p, 0.0);
+    for (int i = 0; i < n; i++, v += width)
+      for (int s = 0; s < width; s++)
+        for (int t = 0; t < width; t++)
+          out[(f[i] + s) * p + f[i] + t] += (double)v[s] * v[t];
+  }
+
+  template <class T>
+  void BandedDesignT<T>::to_dense(double* out) const {
+    std::memset(out, 0, sizeof(double) * n * d * p);
+    for (int j = 0; j < d; j++)
+      for (int i = 0; i < n; i++)
+        for (int s = 0; s < width; s++)
+          out[(size_t)j * p * n + (size_t)(first[(size_t)j * n + i] + s) * n + i] = values[((size_t)j * n + i) * width + s];
+  }
+
+  template <class T>
+  size_t BandedDesignT<T>::nbytes() const {
+    return first.size() * sizeof(int) + values.size() * sizeof(T);
+  }
+
+  template <class T>
+  void bspline_banded(const double* x, int n, int d, const double* knots, int nknots, int degree, BandedDesignT<T>& out) {
+    int width = degree + 1;
+    check_features(x, n, d);
+    out = BandedDesignT<T>(n, d, nknots - degree - 1, width);
+    BandedDesignT<T>& X = out;
+    parallel_features(d, [=, &X](int j) {
+      const double* t = knots + (size_t)j * nknots;
+      vector<double> block((size_t)kBasisBlock * width);
+      for (int i0 = 0; i0 < n; i0 += kBasisBlock) {
+        size_t at = (size_t)j * n + i0;
+        int count = std::min(kBasisBlock, n - i0);
+        // The recurrence always runs in double; only the stored values are
+        // narrowed.
+        bspline_eval(t, nknots, degree, x + at, count, &X.first[at], block.data());
+        std::copy(block.begin(), block.begin() + (size_t)count * width, X.values.begin() + at * width);
+      }
+    });
+  }
+
+  template class BandedDesignT<double>;
+  template class BandedDesignT<float>;
+  template void bspline_banded<double>(const double*, int, int, const double*, int, int, BandedDesign&);
+  template void bspline_banded<float>(const double*, int, int, const double*, int, int, BandedDesignF&);
+}
@@ -0,0 +1,43 @@
+#ifndef BANDED_H
+#define BANDED_H
+
+#include <cstddef>
+#include <vector>
+using std::vector;
+
+namespace SAM {
+  // Compressed design for spline groups. A degree-q B-spline basis has at
+  // most width = q+1 nonzero values per sample and feature, and they are
+  // consecutive, so sample i of group j is stored as the index of its first
+  // nonzero basis plus `width` values instead of all p of them. As with
+  // DenseDesignT, T is only the storage type of the values.
+  template <class T>
+  class BandedDesignT {
+  public:
+    BandedDesignT() : n(0), d(0), p(0), width(0) {}
+    BandedDesignT(int n, int d, int p, int width);
+
+    // out[k] = sum_i X_j(i, k) * r[i], k < p.
+    void xtr(int j, const double* r, double* out) const;
+    // r[i] -= sum_k X_j(i, k) * delta[k].
+    void axpy(int j, const double* delta, double* r) const;
+    // out = X_j^T X_j, p x p.
+    void gram(int j, double* out) const;
+    // Writes the dense j*p*n + k*n + i layout.
+    void to_dense(double* out) const;
+    size_t nbytes() const;
+
+    int n, d, p, width;
+    vector<int> first;      // first[j*n + i]
+    vector<T> values;       // values[(j*n + i)*width + s] is basis first+s
+  };
+
+  typedef BandedDesignT<double> BandedDesign;
+  typedef BandedDesignT<float> BandedDesignF;
+
+  // Banded counterpart of bspline_basis.
+  template <class T>
+  void bspline_banded(const double* x, int n, int d, const double* knots, int nknots, int degree, BandedDesignT<T>& out);
+}
+
+#endif
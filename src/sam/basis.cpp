@@ -0,0 +1,108 @@
+#include "basis.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "thread_pool.h"
+
+using std::vector;
+
+namespace SAM {
+  void parallel_features(int d, const std::function<void(int)>& f) {
+    parallel_for(d, f);
+  }
+
+  void check_features(const double* x, int n, int d) {
+    for (size_t a = 0; a < (size_t)n * d; a++)
+      if (!std::isfinite(x[a]))
+        throw std::invalid_argument("spline features must be finite");
+  }
+
+  void bspline_knots(const double* x, int n, int d, int p, int degree, double* knots) {
+    int nknots = p + degree + 1, ninterior = p - degree - 1;
+    check_features(x, n, d);
+    parallel_features(d, [=](int j) {
+      vector<double> v(x + (size_t)j * n, x + (size_t)(j + 1) * n);
+      std::sort(v.begin(), v.end());
+      double* t = knots + (size_t)j * nknots;
+      for (int s = 0; s <= degree; s++) {
+        t[s] = v.front();
+        t[nknots - 1 - s] = v.back();
+      }
+      for (int l = 1; l <= ninterior; l++)
+        t[degree + l] = v[(size_t)((double)l / (ninterior + 1) * (n - 1))];
+    });
+  }
+
+  void bspline_eval(const double* t, int nknots, int degree, const double* x, int count, int* first, double* values) {
+    const int B = kBasisBlock;
+    int last_span = nknots - degree - 2;
+    double lo = t[degree], hi = t[last_span + 1];
+
+    double xx[B];
+    int span[B];
+    for (int b = 0; b < count; b++) {
+      xx[b] = std::min(std::max(x[b], lo), hi);
+      // Knot span [t[s], t[s+1]) holding the point; the right boundary
+      // belongs to the last non-empty span.
+      int s = std::upper_bound(t, t + nknots, xx[b]) - t - 1;
+      span[b] = std::min(std::max(s, degree), last_span);
+    }
+
+    // N[s][b] is the s-th nonzero basis at sample b, built up one degree at
+    // a time (The NURBS Book, A2.2) with samples in the inner loop.
+    vector<double> N((degree + 1) * B), left((degree + 1) * B), right((degree + 1) * B);
+    for (int b = 0; b < count; b++)
+      N[b] = 1;
+    for (int r = 1; r <= degree; r++) {
+      for (int b = 0; b < count; b++) {
+        left[r * B + b] = xx[b] - t[span[b] + 1 - r];
+        right[r * B + b] = t[span[b] + r] - xx[b];
+      }
+      double saved[B];
+      std::fill(saved, saved + count, 0.0);
+      for (int s = 0; s < r; s++) {
+        const double* rs = &right[(s + 1) * B];
+        const double* lrs = &left[(r - s) * B];
+        double* Ns = &N[s * B];
+        for (int b = 0; b < count; b++) {
+          double den = rs[b] + lrs[b];
+          double temp = den > 0 ? Ns[b] / den : 0;
+          Ns[b] = saved[b] + rs[b] * temp;
+          saved[b] = lrs[b] * temp;
+        }
+      }
+      std::copy(saved, saved + count, &N[r * B]);
+    }
+
+    for (int b = 0; b < count; b++) {
+      first[b] = span[b] - degree;
+      for (int s = 0; s <= degree; s++)
+        values[b * (degree + 1) + s] = N[s * B + b];
+    }
+  }
+
+  template <class T>
+  void bspline_basis(const double* x, int n, int d, const double* knots, int nknots, int degree, T* out) {
+    int p = nknots - degree - 1, width = degree + 1;
+    check_features(x, n, d);
+    parallel_features(d, [=](int j) {
+      const double* t = knots + (size_t)j * nknots;
+      T* block = out + (size_t)j * p * n;
+      std::fill(block, block + (size_t)p * n, T(0));
+      int first[kBasisBlock];
+      vector<double> vals(kBasisBlock * width);
+      for (int i0 = 0; i0 < n; i0 += kBasisBlock) {
+        int count = std::min(kBasisBlock, n - i0);
+        bspline_eval(t, nknots, degree, x + (size_t)j * n + i0, count, first, vals.data());
+        for (int b = 0; b < count; b++)
+          for (int s = 0; s < width; s++)
+            block[(size_t)(first[b] + s) * n + i0 + b] = (T)vals[b * width + s];
+      }
+    });
+  }
+
+  template void bspline_basis<double>(const double*, int, int, const double*, int, int, double*);
+  template void bspline_basis<float>(const double*, int, int, const double*, int, int, float*);
+}
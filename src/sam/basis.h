@@ -0,0 +1,39 @@
+#ifndef BASIS_H
+#define BASIS_H
+
+#include <functional>
+
+namespace SAM {
+  // Samples evaluated together by bspline_eval. The recurrence runs across a
+  // block of samples in its innermost loop so the compiler can vectorize it.
+  const int kBasisBlock = 64;
+
+  // Runs f(j) for every feature j on the shared thread pool.
+  extern void parallel_features(int d, const std::function<void(int)>& f);
+
+  // Throws std::invalid_argument unless every value of the n x d feature
+  // matrix x is finite. Every spline expansion checks its input with it.
+  extern void check_features(const double* x, int n, int d);
+
+  // Clamped knot sequences for d features: `degree`+1 copies of each boundary
+  // (the feature's min and max) around p-degree-1 interior knots placed at
+  // sample quantiles. x is n x d column-major; knots is d x (p+degree+1)
+  // row-major, one knot sequence per feature.
+  extern void bspline_knots(const double* x, int n, int d, int p, int degree, double* knots);
+
+  // de Boor evaluation of the degree+1 B-splines that are nonzero at each of
+  // x[0..count), count <= kBasisBlock. For sample b, first[b] is the index of
+  // the first nonzero basis and values[b*(degree+1) + s] is basis first[b]+s.
+  // Points outside the boundary knots are clamped onto them; x must be finite
+  // (the callers run check_features first).
+  extern void bspline_eval(const double* t, int nknots, int degree, const double* x, int count, int* first, double* values);
+
+  // Expands the n x d column-major feature matrix x into the solver's design
+  // layout out[j*p*n + k*n + i], p = nknots-degree-1, using knots as produced
+  // by bspline_knots. Features are expanded in parallel. T = float stores the
+  // basis in single precision; evaluation itself is always double.
+  template <class T>
+  void bspline_basis(const double* x, int n, int d, const double* knots, int nknots, int degree, T* out);
+}
+
+#endif
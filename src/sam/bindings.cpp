@@ -1,10 +1,18 @@
 #include <pybind11/pybind11.h>
+#include <cstdlib>
 #include "math.hpp"
 #include "backend/c_api/grpLR.h"
 #include "c_api.h"
+#include "kernels.h"
+#include "thread_pool.h"
 
 namespace py = pybind11;
 
+template <class T>
+static py::array_t<T> to_array(const vector<T>& v) {
+  return py::array_t<T>(v.size(), v.data());
+}
+
 PYBIND11_PLUGIN(sam) {
   py::module m("sam", R"doc(
         Python module
@@ -29,7 +37,299 @@ PYBIND11_PLUGIN(sam) {
         Some other information about the subtract function.
     )doc");
 
-  m.def("__grplasso", &__grplasso);
+  // Pick the numeric kernels once per process; SAM_KERNELS overrides the
+  // choice (e.g. to compare against the scalar variant, or to make audited
+  // runs bit-reproducible across machines). A variant this build or CPU
+  // does not have only warns: the module must still import.
+  const char* kernels = std::getenv("SAM_KERNELS");
+  try {
+    SAM::select_kernels(kernels && *kernels ? kernels : "auto");
+  } catch (const std::invalid_argument& e) {
+    SAM::select_kernels("auto");
+    string msg = string("ignoring SAM_KERNELS: ") + e.what();
+    if (PyErr_WarnEx(PyExc_RuntimeWarning, msg.c_str(), 1) < 0)
+      throw py::error_already_set();
+  }
+
+  m.def("kernel_variant", &SAM::kernel_variant, R"doc(
+        Name of the numeric kernel variant in use: avx512, avx2, scalar or
+        reproducible
+    )doc");
+
+  m.def("kernel_variants", &SAM::kernel_variants, R"doc(
+        Kernel variants this CPU supports, fastest first, then reproducible
+    )doc");
+
+  m.def("select_kernels", &SAM::select_kernels, py::arg("variant") = "auto", R"doc(
+        Switch the numeric kernels to ``variant`` (auto, avx512, avx2,
+        scalar or reproducible) and return the variant in use. The
+        reproducible variant is slower but gives bit-identical fits on every
+        CPU; no variant depends on the thread count.
+    )doc");
+
+  m.def("set_num_threads", &SAM::set_num_threads, py::arg("nthreads") = 0, R"doc(
+        Size of the thread pool shared by all parallel stages
+
+        Counts the calling thread; 0 restores the default (OMP_NUM_THREADS,
+        else one thread per core).
+    )doc");
+
+  m.def("get_num_threads", &SAM::get_num_threads, R"doc(
+        Current size of the shared thread pool
+    )doc");
+
+  py::class_<SAM::GrpLassoWorkspace>(m, "GrpLassoWorkspace", R"doc(
+        Reusable scratch memory for group lasso fits
+
+        Holds 64-byte aligned design, residual and coefficient buffers. Pass the same workspace to repeated fits so memory is
+        allocated once; ``huge_pages`` advises large buffers for transparent
+        huge pages.
+    )doc")
+      .def(py::init<bool>(), py::arg("huge_pages") = false)
+      .def("reserve", &__workspace_reserve, py::arg("n"), py::arg("d"), py::arg("p"), py::arg("with_design") = true, py::arg("single") = false)
+      .def("compatible", &SAM::GrpLassoWorkspace::compatible, py::arg("n"), py::arg("d"), py::arg("p"), py::arg("single") = false)
+      .def_property_readonly("nbytes", &SAM::GrpLassoWorkspace::nbytes);
+
+  m.def("__grplasso", &__grplasso,
+        py::arg("y"), py::arg("X"), py::arg("lambda"), py::arg("max_ite"),
+        py::arg("thol"), py::arg("regfunc"), py::arg("input"),
+        py::arg("workspace") = nullptr);
+
+  m.def("__grplasso_array", &__grplasso_array,
+        py::arg("y"), py::arg("X"), py::arg("lambda"), py::arg("max_ite"),
+        py::arg("thol"), py::arg("regfunc"), py::arg("input"), py::arg("p") = 0,
+        py::arg("workspace") = nullptr,
+        R"doc(
+        Group lasso on NumPy buffers
+
+        X is an (n, d, p) array or an (n, d*p) matrix (pass ``p`` for the
+        latter). A writeable Fortran-ordered (n, d*p) float64 matrix, or any
+        writeable array with the same strides, is handed to the solver
+        without a copy; a read-only one is copied.
+    )doc");
+
+  m.def("__aligned_design", &__aligned_design,
+        py::arg("n"), py::arg("d"), py::arg("p"), py::arg("single") = false, R"doc(
+        Zero-filled (n, d*p) design buffer in the padded, cache-aligned layout
+
+        Columns are 64-byte aligned with a stride rounded up to 64 bytes.
+        Fill it in place (float32 with ``single``) and pass it to
+        ``__grplasso_path``, which then uses it without a copy.
+    )doc");
+
+  m.def("__bspline_knots", &__bspline_knots,
+        py::arg("X"), py::arg("p"), py::arg("degree") = 3, R"doc(
+        Clamped quantile knots for a B-spline basis of size p per feature
+
+        Returns a (d, p+degree+1) matrix, one knot sequence per column of X.
+    )doc");
+
+  m.def("__bspline_basis", &__bspline_basis,
+        py::arg("X"), py::arg("knots"), py::arg("degree") = 3,
+        py::arg("single") = false, R"doc(
+        B-spline basis expansion of an (n, d) feature matrix
+
+        Returns the Fortran-ordered (n, d*p) design that ``__grplasso_path``
+        uses without copying; float32 with ``single``.
+    )doc");
+
+  py::class_<SAM::BandedDesign>(m, "BandedDesign", R"doc(
+        Spline design storing only the degree+1 nonzero basis values per
+        sample and feature
+    )doc")
+      .def_readonly("n", &SAM::BandedDesign::n)
+      .def_readonly("d", &SAM::BandedDesign::d)
+      .def_readonly("p", &SAM::BandedDesign::p)
+      .def_readonly("width", &SAM::BandedDesign::width)
+      .def_property_readonly("nbytes", &SAM::BandedDesign::nbytes)
+      .def("to_dense", &__banded_to_dense<double>);
+
+  py::class_<SAM::BandedDesignF>(m, "BandedDesignF", R"doc(
+        BandedDesign with float32 basis values
+    )doc")
+      .def_readonly("n", &SAM::BandedDesignF::n)
+      .def_readonly("d", &SAM::BandedDesignF::d)
+      .def_readonly("p", &SAM::BandedDesignF::p)
+      .def_readonly("width", &SAM::BandedDesignF::width)
+      .def_property_readonly("nbytes", &SAM::BandedDesignF::nbytes)
+      .def("to_dense", &__banded_to_dense<float>);
+
+  m.def("__bspline_banded", &__bspline_banded,
+        py::arg("X"), py::arg("knots"), py::arg("degree") = 3,
+        py::arg("single") = false, R"doc(
+        B-spline basis expansion into a BandedDesign (BandedDesignF with
+        ``single``)
+    )doc");
+
+  py::class_<SAM::BinnedDesign>(m, "BinnedDesign", R"doc(
+        Spline design stored as one-byte feature bins plus a per-group table
+        of basis values at each bin
+    )doc")
+      .def_readonly("n", &SAM::BinnedDesign::n)
+      .def_readonly("d", &SAM::BinnedDesign::d)
+      .def_readonly("p", &SAM::BinnedDesign::p)
+      .def_property_readonly("nbytes", &SAM::BinnedDesign::nbytes)
+      .def("to_dense", &__binned_to_dense);
+
+  m.def("__bspline_binned", &__bspline_binned,
+        py::arg("X"), py::arg("knots"), py::arg("degree") = 3,
+        py::arg("max_bins") = 256, R"doc(
+        B-spline basis expansion into a BinnedDesign
+    )doc");
+
+  py::class_<SAM::SolverOptions>(m, "SolverOptions", R"doc(
+        Options of the native group lasso path solver
+
+        ``regfunc`` is L1, MCP or SCAD; ``gamma`` their concavity (0 picks
+        the default). With ``lambda_input`` = 0, lambda holds ratios of
+        lambda_max. ``screening`` is none, strong or gap_safe;
+        ``working_set`` switches to the working-set outer loop;
+        ``orthonormalize`` centers and orthonormalizes every group;
+        ``covariance`` (auto, on, off) selects Gram-cached updates;
+        ``specialize`` = False bypasses the solvers compiled for p in
+        {3, 4, 5, 6, 8, 10}; ``parallel_cd`` updates batches of groups
+        concurrently (for very large d); ``cv_gram`` lets CV folds downdate
+        the full-data Gram columns; ``alo`` fills PathResult.alo with the
+        approximate leave-one-out risk per lambda; ``criteria`` (off, auto,
+        exact, hutchinson) fills PathResult.edf, gcv, aic, bic and ebic, with
+        ``ebic_gamma`` weighing the eBIC model-space term.
+    )doc")
+      .def(py::init<>())
+      .def_readwrite("max_ite", &SAM::SolverOptions::max_ite)
+      .def_readwrite("thol", &SAM::SolverOptions::thol)
+      .def_readwrite("regfunc", &SAM::SolverOptions::regfunc)
+      .def_readwrite("gamma", &SAM::SolverOptions::gamma)
+      .def_readwrite("lambda_input", &SAM::SolverOptions::lambda_input)
+      .def_readwrite("screening", &SAM::SolverOptions::screening)
+      .def_readwrite("working_set", &SAM::SolverOptions::working_set)
+      .def_readwrite("orthonormalize", &SAM::SolverOptions::orthonormalize)
+      .def_readwrite("covariance", &SAM::SolverOptions::covariance)
+      .def_readwrite("specialize", &SAM::SolverOptions::specialize)
+      .def_readwrite("parallel_cd", &SAM::SolverOptions::parallel_cd)
+      .def_readwrite("cv_gram", &SAM::SolverOptions::cv_gram)
+      .def_readwrite("alo", &SAM::SolverOptions::alo)
+      .def_readwrite("criteria", &SAM::SolverOptions::criteria)
+      .def_readwrite("ebic_gamma", &SAM::SolverOptions::ebic_gamma);
+
+  py::class_<SAM::PathResult>(m, "PathResult")
+      .def_readonly("n", &SAM::PathResult::n)
+      .def_readonly("d", &SAM::PathResult::d)
+      .def_readonly("p", &SAM::PathResult::p)
+      .def_readonly("nlambda", &SAM::PathResult::nlambda)
+      .def_property_readonly("lambda_", [](const SAM::PathResult& r) { return to_array(r.lambda); })
+      .def_property_readonly("w", [](const SAM::PathResult& r) {
+        return py::array_t<double>({r.nlambda, r.d, r.p}, r.w.data());
+      })
+      .def_property_readonly("df", [](const SAM::PathResult& r) { return to_array(r.df); })
+      .def_property_readonly("sse", [](const SAM::PathResult& r) { return to_array(r.sse); })
+      .def_property_readonly("func_norm", [](const SAM::PathResult& r) {
+        return py::array_t<double>({r.nlambda, r.d}, r.func_norm.data());
+      })
+      .def_property_readonly("iterations", [](const SAM::PathResult& r) { return to_array(r.iterations); })
+      .def_property_readonly("strong_set", [](const SAM::PathResult& r) { return to_array(r.strong_set); })
+      .def_property_readonly("kkt_violations", [](const SAM::PathResult& r) { return to_array(r.kkt_violations); })
+      .def_property_readonly("safe_set", [](const SAM::PathResult& r) { return to_array(r.safe_set); })
+      .def_property_readonly("gap", [](const SAM::PathResult& r) { return to_array(r.gap); })
+      .def_property_readonly("working_set", [](const SAM::PathResult& r) { return to_array(r.working_set); })
+      .def_property_readonly("intercept", [](const SAM::PathResult& r) { return to_array(r.intercept); })
+      .def_property_readonly("gram_cached", [](const SAM::PathResult& r) { return to_array(r.gram_cached); })
+      .def_property_readonly("alo", [](const SAM::PathResult& r) { return to_array(r.alo); })
+      .def_property_readonly("edf", [](const SAM::PathResult& r) { return to_array(r.edf); })
+      .def_property_readonly("gcv", [](const SAM::PathResult& r) { return to_array(r.gcv); })
+      .def_property_readonly("aic", [](const SAM::PathResult& r) { return to_array(r.aic); })
+      .def_property_readonly("bic", [](const SAM::PathResult& r) { return to_array(r.bic); })
+      .def_property_readonly("ebic", [](const SAM::PathResult& r) { return to_array(r.ebic); });
+
+  py::class_<SAM::CVResult>(m, "CVResult", R"doc(
+        K-fold cross-validation of a path: held-out error per lambda (cvm),
+        its standard error (cvsd), the per-fold errors and the full-data path
+    )doc")
+      .def_readonly("nfolds", &SAM::CVResult::nfolds)
+      .def_readonly("nlambda", &SAM::CVResult::nlambda)
+      .def_property_readonly("lambda_", [](const SAM::CVResult& r) { return to_array(r.lambda); })
+      .def_property_readonly("cvm", [](const SAM::CVResult& r) { return to_array(r.cvm); })
+      .def_property_readonly("cvsd", [](const SAM::CVResult& r) { return to_array(r.cvsd); })
+      .def_property_readonly("fold_loss", [](const SAM::CVResult& r) {
+        return py::array_t<double>({r.nfolds, r.nlambda}, r.fold_loss.data());
+      })
+      .def_property_readonly("fold_size", [](const SAM::CVResult& r) { return to_array(r.fold_size); })
+      .def_readonly("index_min", &SAM::CVResult::index_min)
+      .def_readonly("index_1se", &SAM::CVResult::index_1se)
+      .def_readonly("lambda_min", &SAM::CVResult::lambda_min)
+      .def_readonly("lambda_1se", &SAM::CVResult::lambda_1se)
+      .def_readonly("gram_columns", &SAM::CVResult::gram_columns)
+      .def_property_readonly("folds_used", [](const SAM::CVResult& r) { return to_array(r.folds_used); })
+      .def_property_readonly("pruned_round", [](const SAM::CVResult& r) { return to_array(r.pruned_round); })
+      .def_property_readonly("prune_z", [](const SAM::CVResult& r) { return to_array(r.prune_z); })
+      .def_property_readonly("round_folds", [](const SAM::CVResult& r) { return to_array(r.round_folds); })
+      .def_readonly("path", &SAM::CVResult::path);
+
+  py::class_<SAM::GroupTransform>(m, "GroupTransform", R"doc(
+        Per-group centering and orthonormalization of a design
+
+        Fit once and pass to every path or CV fit on the same design.
+    )doc")
+      .def_readonly("d", &SAM::GroupTransform::d)
+      .def_readonly("p", &SAM::GroupTransform::p)
+      .def_readonly("centered", &SAM::GroupTransform::centered)
+      .def_property_readonly("rank", [](const SAM::GroupTransform& t) { return to_array(t.rank); });
+
+  m.def("__group_transform", &__group_transform_banded, py::arg("X"), py::arg("center") = true);
+  m.def("__group_transform", &__group_transform_banded_f32, py::arg("X"), py::arg("center") = true);
+  m.def("__group_transform", &__group_transform_binned, py::arg("X"), py::arg("center") = true);
+  m.def("__group_transform", &__group_transform,
+        py::arg("X"), py::arg("p") = 0, py::arg("center") = true);
+
+  m.def("__grplasso_path", &__grplasso_path_banded,
+        py::arg("y"), py::arg("X"), py::arg("lambda"),
+        py::arg("options") = SAM::SolverOptions(), py::arg("workspace") = nullptr,
+        py::arg("transform") = nullptr);
+  m.def("__grplasso_path", &__grplasso_path_banded_f32,
+        py::arg("y"), py::arg("X"), py::arg("lambda"),
+        py::arg("options") = SAM::SolverOptions(), py::arg("workspace") = nullptr,
+        py::arg("transform") = nullptr);
+  m.def("__grplasso_path", &__grplasso_path_binned,
+        py::arg("y"), py::arg("X"), py::arg("lambda"),
+        py::arg("options") = SAM::SolverOptions(), py::arg("workspace") = nullptr,
+        py::arg("transform") = nullptr);
+  // The dense entry points take any X and pick float32 or float64 storage
+  // from its dtype, so they come after the design-class overloads.
+  m.def("__grplasso_path", &__grplasso_path,
+        py::arg("y"), py::arg("X"), py::arg("lambda"), py::arg("p") = 0,
+        py::arg("options") = SAM::SolverOptions(), py::arg("workspace") = nullptr,
+        py::arg("transform") = nullptr, R"doc(
+        Native group lasso path with strong-rule or gap-safe screening
+
+        X is a dense array (as for ``__grplasso_array``, but any column
+        stride is used without a copy, e.g. ``__aligned_design``; float32
+        arrays are kept in single precision), a BandedDesign, BandedDesignF or a
+        BinnedDesign; a GroupTransform of the same design orthonormalizes
+        the groups. Returns a PathResult holding the coefficients, df,
+        sse, func_norm and per-lambda screening statistics.
+    )doc");
+
+  m.def("__cv_grplasso", &__cv_grplasso,
+        py::arg("y"), py::arg("X"), py::arg("folds"), py::arg("lambda"),
+        py::arg("p") = 0, py::arg("options") = SAM::SolverOptions(), R"doc(
+        K-fold cross-validation of the native path on a dense X
+
+        ``folds`` labels every row with its held-out fold (0 .. K-1); a
+        float32 X is kept in single precision. The folds share X,
+        warm-start from the full-data path and run on the thread pool.
+        Returns a CVResult.
+    )doc");
+
+  m.def("__cv_grplasso_halving", &__cv_grplasso_halving,
+        py::arg("y"), py::arg("X"), py::arg("folds"), py::arg("lambda"),
+        py::arg("p") = 0, py::arg("options") = SAM::SolverOptions(),
+        py::arg("initial_folds") = 2, py::arg("z") = 2.0, R"doc(
+        Successive-halving K-fold CV
+
+        Scores the grid on ``initial_folds`` folds, then on twice as many
+        per round; lambdas more than ``z`` paired standard errors worse than
+        the incumbent are pruned. The CVResult reports ``folds_used``,
+        ``pruned_round``, ``prune_z`` and ``round_folds``.
+    )doc");
 
   return m.ptr();
 }
@@ -0,0 +1,116 @@
+#include "binned.h"
+#include "basis.h"
+#include <algorithm>
+#include <cstring>
+
+namespace SAM {
+  BinnedDesign::BinnedDesign(int n, int d, int p)
+    : n(n), d(d), p(p), nbins(d), bins((size_t)n * d), table((size_t)d * kMaxBins * p) {}
+
+  void BinnedDesign::xtr(int j, const double* r, double* out) const {
+    const unsigned char* bj = &bins[(size_t)j * n];
+    const double* tj = &table[(size_t)j * kMaxBins * p];
+    double hist[kMaxBins] = {0};
+    for (int i = 0; i < n; i++)
+      hist[bj[i]] += r[i];
+    std::fill(out, out + p, 0.0);
+    for (int b = 0; b < nbins[j]; b++)
+      for (int k = 0; k < p; k++)
+        out[k] += hist[b] * tj[b * p + k];
+  }
+
+  void BinnedDesign::axpy(int j, const double* delta, double* r) const {
+    const unsigned char* bj = &bins[(size_t)j * n];
+    const double* tj = &table[(size_t)j * kMaxBins * p];
+    double v[kMaxBins];
+    for (int b = 0; b < nbins[j]; b++) {
+      v[b] = 0;
+      for (int k = 0; k < p; k++)
+        v[b] += tj[b * p + k] * delta[k];
+    }
+    for (int i = 0; i < n; i++)
+      r[i] -= v[bj[i]];
+  }
+
+  void BinnedDesign::gram(int j, double* out) const {
+    const unsigned char* bj = &bins[(size_t)j * n];
+    const double* tj = &table[(size_t)j * kMaxBins * p];
+    double count[kMaxBins] = {0};
+    for (int i = 0; i < n; i++)
+      count[bj[i]] += 1;
+    std::fill(out, out + p * p, 0.0);
+    for (int b = 0; b < nbins[j]; b++)
+      for (int k = 0; k < p; k++)
+        for (int l = 0; l < p; l++)
+          out[k * p + l] += count[b] * tj[b * p + k] * tj[b * p + l];
+  }
+
+  void BinnedDesign::to_dense(double* out) const {
+    for (int j = 0; j < d; j++)
+      for (int k = 0; k < p; k++)
+        for (int i = 0; i < n; i++)
+          out[(size_t)j * p * n + (size_t)k * n + i] = table[((size_t)j * kMaxBins + bins[(size_t)j * n + i]) * p + k];
+  }
+
+  size_t BinnedDesign::nbytes() const {
+    return bins.size() + table.size() * sizeof(double) + nbins.size() * sizeof(int);
+  }
+
+  void bspline_binned(const double* x, int n, int d, const double* knots, int nknots, int degree, int max_bins, BinnedDesign& out) {
+    int p = nknots - degree - 1, width = degree + 1;
+    max_bins = std::min(std::max(max_bins, 1), kMaxBins);
+    check_features(x, n, d);
+    out = BinnedDesign(n, d, p);
+    BinnedDesign& X = out;
+    parallel_features(d, [=, &X](int j) {
+      const double* xj = x + (size_t)j * n;
+      vector<double> v(xj, xj + n);
+      std::sort(v.begin(), v.end());
+
+      // upper[b] is the largest value falling in bin b. With few distinct
+      // values every value gets its own bin, otherwise the cuts sit at
+      // quantiles (merged where ties make neighbouring cuts coincide) and
+      // the last bin always closes at the maximum.
+      vector<double> upper;
+      vector<double> u(v);
+      u.erase(std::unique(u.begin(), u.end()), u.end());
+      if ((int)u.size() <= max_bins) {
+        upper = u;
+      } else {
+        for (int b = 1; b < max_bins; b++) {
+          double cut = v[(size_t)((double)b / max_bins * (n - 1))];
+          if (upper.empty() || cut > upper.back())
+            upper.push_back(cut);
+        }
+        if (upper.empty() || upper.back() < v.back())
+          upper.push_back(v.back());
+      }
+      int nb = upper.size();
+      X.nbins[j] = nb;
+
+      vector<double> sum(nb, 0.0), count(nb, 0.0);
+      unsigned char* bj = &X.bins[(size_t)j * n];
+      for (int i = 0; i < n; i++) {
+        int b = std::lower_bound(upper.begin(), upper.end(), xj[i]) - upper.begin();
+        bj[i] = (unsigned char)b;
+        sum[b] += xj[i];
+        count[b] += 1;
+      }
+
+      vector<double> rep(nb);
+      for (int b = 0; b < nb; b++)
+        rep[b] = sum[b] / count[b];
+      const double* t = knots + (size_t)j * nknots;
+      double* tj = &X.table[(size_t)j * kMaxBins * p];
+      int first[kBasisBlock];
+      vector<double> vals(kBasisBlock * width);
+      for (int b0 = 0; b0 < nb; b0 += kBasisBlock) {
+        int cnt = std::min(kBasisBlock, nb - b0);
+        bspline_eval(t, nknots, degree, &rep[b0], cnt, first, vals.data());
+        for (int b = 0; b < cnt; b++)
+          for (int s = 0; s < width; s++)
+            tj[(b0 + b) * p + first[b] + s] = vals[b * width + s];
+      }
+    });
+  }
+}
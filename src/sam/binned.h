@@ -0,0 +1,45 @@
+#ifndef BINNED_H
+#define BINNED_H
+
+#include <cstddef>
+#include <vector>
+using std::vector;
+
+namespace SAM {
+  const int kMaxBins = 256;
+
+  // Histogram-binned design. Each raw feature is quantized once into at most
+  // 256 bins and kept as one byte per sample; group j keeps a table of the p
+  // basis values at each bin's representative point. X_j^T r accumulates r
+  // into a per-bin histogram and multiplies it by the table, so memory is
+  // O(n*d) bytes and the dense design never exists. Samples sharing a bin
+  // share a basis row, so this approximates the exact expansion.
+  class BinnedDesign {
+  public:
+    BinnedDesign() : n(0), d(0), p(0) {}
+    BinnedDesign(int n, int d, int p);
+
+    // out[k] = sum_i X_j(i, k) * r[i], k < p.
+    void xtr(int j, const double* r, double* out) const;
+    // r[i] -= sum_k X_j(i, k) * delta[k].
+    void axpy(int j, const double* delta, double* r) const;
+    // out = X_j^T X_j, p x p.
+    void gram(int j, double* out) const;
+    // Writes the dense j*p*n + k*n + i layout.
+    void to_dense(double* out) const;
+    size_t nbytes() const;
+
+    int n, d, p;
+    vector<int> nbins;            // nbins[j]
+    vector<unsigned char> bins;   // bins[j*n + i]
+    vector<double> table;         // table[(j*kMaxBins + b)*p + k]
+  };
+
+  // Quantizes each feature into at most max_bins quantile bins (one bin per
+  // distinct value when there are few enough) and tabulates the B-spline
+  // basis at the mean of each bin. Throws std::invalid_argument on NaN or
+  // infinite x.
+  extern void bspline_binned(const double* x, int n, int d, const double* knots, int nknots, int degree, int max_bins, BinnedDesign& out);
+}
+
+#endif
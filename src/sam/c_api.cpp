@@ -2,6 +2,10 @@
 #include <stdlib.h> // for NULL
 #include <pybind11/stl.h>
 #include <cassert>
+#include <mutex>
+#include <stdexcept>
+#include "basis.h"
+#include "design.h"
 #include "backend/c_api/grplasso.h"
 #include "backend/c_api/grpSVM.h"
 #include "backend/c_api/grpLR.h"
@@ -11,7 +15,36 @@ using std::vector;
 using std::string;
 using std::tuple;
 
-tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso(vector<double> y, vector<vector<vector<double>>> X, vector<double> lambda, int max_ite, double thol, string regfunc, int input) {
+// The solver bindings release the GIL once their inputs are pinned: arrays
+// are read through raw pointers, option objects are copied, and results
+// are converted back to Python only after the GIL is reacquired. The
+// native solver keeps no global mutable state (the kernel table and the
+// thread pool are set up front and synchronized), so independent fits can
+// run from several Python threads. The backend's legacy solver is not ours
+// to audit, so calls into it are serialized.
+static std::mutex backend_mu;
+
+// Claims a workspace for one fit, so two threads never share its buffers.
+class WorkspaceLock {
+public:
+  explicit WorkspaceLock(SAM::GrpLassoWorkspace& ws) : ws(ws) {
+    if (!ws.try_acquire())
+      throw std::runtime_error("the workspace is in use by another fit");
+  }
+  ~WorkspaceLock() { ws.release(); }
+
+private:
+  SAM::GrpLassoWorkspace& ws;
+};
+
+// reserve() frees the buffers it outgrows, so from Python it claims the
+// workspace like a fit does and fails while a fit is using it.
+void __workspace_reserve(SAM::GrpLassoWorkspace& ws, int n, int d, int p, bool with_design, bool single) {
+  WorkspaceLock claim(ws);
+  ws.reserve(n, d, p, with_design, single);
+}
+
+tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso(vector<double> y, vector<vector<vector<double>>> X, vector<double> lambda, int max_ite, double thol, string regfunc, int input, SAM::GrpLassoWorkspace* workspace) {
   // return df, sse, func_norm
   int n = X.size(), d = X[0].size(), p = X[0][0].size();
   int nlambda = lambda.size();
@@ -21,25 +54,401 @@ tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso(ve
   vector<double> func_norm(nlambda);
   vector<double> w(nlambda*d*p);
 
-  double* XX = new double[n * d * p];
-
+  // Without a caller-owned workspace the buffers live for this call only.
+  SAM::GrpLassoWorkspace local;
+  SAM::GrpLassoWorkspace& ws = workspace ? *workspace : local;
+  WorkspaceLock claim(ws);
+  py::gil_scoped_release release;
+  ws.reserve(n, d, p);
+  double* XX = ws.design();
 
   for (int i = 0; i < n; i++) {
     for (int j = 0; j < d; j++) {
       for (int k = 0; k < p; k++) {
-        XX[j*p*n + k*n + i] = X[i][j][k];
+        XX[(size_t)j*p*n + k*n + i] = X[i][j][k];
       }
     }
   }
 
   const char *p_regfunc = regfunc.data ();
 
+  std::lock_guard<std::mutex> serial(backend_mu);
   grplasso(y.data(), XX, lambda.data(), &nlambda, &n, &d, &p, w.data(), &max_ite, &thol, &p_regfunc, &input, df.data(), sse.data(), func_norm.data());
 
   return make_tuple(df, sse, func_norm, w);
   // return df;
 }
 
+// Whether an array with the given extents and (byte) strides is laid out as
+// the solver expects. Axes of extent 1 never move the pointer, so their
+// stride is irrelevant.
+template <class T, int Flags>
+static bool same_layout(const py::array_t<T, Flags>& X, const vector<ssize_t>& strides) {
+  for (int a = 0; a < X.ndim(); a++)
+    if (X.shape(a) > 1 && X.strides(a) != strides[a])
+      return false;
+  return true;
+}
+
+// Pointer to X in the solver's j*p*ld + k*ld + i layout. X is either an
+// (n, d, p) array or an (n, d*p) matrix whose column j*p+k holds basis k of
+// group j; in both cases that layout is a Fortran-ordered (n, d*p) matrix
+// with column stride ld. With `strided`, any ld >= n is taken as is (e.g.
+// the first n rows of a padded buffer from __aligned_design); otherwise
+// the columns must be packed (ld = n), as the legacy solver expects.
+// X is only copied (into the workspace, padded when `strided`) when its
+// strides do not match; a float32 X is copied into the same buffer
+// reinterpreted as floats. The legacy solver takes X as double*, so without
+// `strided` a read-only X is copied too; the native solvers only read it.
+template <class T, int Flags>
+static T* design_buffer(const py::array_t<T, Flags>& X, int& n, int& d, int& p, int& ld, SAM::GrpLassoWorkspace& ws, bool strided) {
+  if (X.ndim() == 3) {
+    n = X.shape(0), d = X.shape(1), p = X.shape(2);
+  } else if (X.ndim() == 2) {
+    if (p <= 0 || X.shape(1) % p != 0)
+      throw py::value_error("a 2-d X needs p > 0 dividing its number of columns");
+    n = X.shape(0), d = X.shape(1) / p;
+  } else {
+    throw py::value_error("X must be an (n, d, p) array or an (n, d*p) matrix");
+  }
+
+  const ssize_t sz = sizeof(T);
+  ld = n;
+  if (strided) {
+    if (X.ndim() == 2 && X.shape(1) > 1)
+      ld = X.strides(1) / sz;
+    else if (X.ndim() == 3 && p > 1)
+      ld = X.strides(2) / sz;
+    else if (X.ndim() == 3 && d > 1)
+      ld = X.strides(1) / (sz * p);
+  }
+  vector<ssize_t> strides;
+  if (X.ndim() == 3)
+    strides = {sz, sz*p*ld, sz*ld};
+  else
+    strides = {sz, sz*ld};
+  if (ld >= n && same_layout(X, strides) && (strided || X.writeable()))
+    return const_cast<T*>(X.data());
+
+  ws.reserve(n, d, p, true, sizeof(T) == sizeof(float));
+  ld = strided ? SAM::padded_stride(n, sizeof(T)) : n;
+  T* buf = reinterpret_cast<T*>(ws.design());
+  if (X.ndim() == 3) {
+    auto x = X.template unchecked<3>();
+    for (int j = 0; j < d; j++)
+      for (int k = 0; k < p; k++)
+        for (int i = 0; i < n; i++)
+          buf[((size_t)j*p + k)*ld + i] = x(i, j, k);
+  } else {
+    auto x = X.template unchecked<2>();
+    for (int c = 0; c < d * p; c++)
+      for (int i = 0; i < n; i++)
+        buf[(size_t)c*ld + i] = x(i, c);
+  }
+  return buf;
+}
+
+// A float32 X is solved in single-precision storage; anything else (other
+// dtypes, lists) converts to float64. The dense entry points decide this
+// from X alone: as pybind11 overloads the choice would also depend on the
+// other arguments (a None workspace or a list lambda sends every call
+// through the converting pass, where a float32 X would be upcast).
+static bool is_float32(const py::object& X) {
+  if (!py::isinstance<py::array>(X))
+    return false;
+  py::dtype dt = py::reinterpret_borrow<py::array>(X).dtype();
+  return dt.kind() == 'f' && dt.itemsize() == (ssize_t)sizeof(float);
+}
+
+static py::array_t<double> dense_array(const py::object& X) {
+  py::array_t<double> A = py::array_t<double>::ensure(X);
+  if (!A)
+    throw py::value_error("X must be a numeric array");
+  return A;
+}
+
+tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso_array(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::array_t<double> X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int max_ite, double thol, string regfunc, int input, int p, SAM::GrpLassoWorkspace* workspace) {
+  SAM::GrpLassoWorkspace local;
+  SAM::GrpLassoWorkspace& ws = workspace ? *workspace : local;
+  WorkspaceLock claim(ws);
+  int n, d, ld;
+  double* XX = design_buffer(X, n, d, p, ld, ws, false);
+  if (y.size() != n)
+    throw py::value_error("y and X disagree on the number of samples");
+  int nlambda = lambda.size();
+
+  vector<int> df(nlambda);
+  vector<double> sse(nlambda*d);
+  vector<double> func_norm(nlambda);
+  vector<double> w(nlambda*d*p);
+
+  // y and lambda are small, and the solver may rescale lambda in place, so
+  // they are always copied.
+  vector<double> yy(y.data(), y.data() + n);
+  vector<double> ll(lambda.data(), lambda.data() + nlambda);
+
+  const char *p_regfunc = regfunc.data ();
+
+  py::gil_scoped_release release;
+  std::lock_guard<std::mutex> serial(backend_mu);
+  grplasso(yy.data(), XX, ll.data(), &nlambda, &n, &d, &p, w.data(), &max_ite, &thol, &p_regfunc, &input, df.data(), sse.data(), func_norm.data());
+
+  return make_tuple(df, sse, func_norm, w);
+}
+
+template <class Design>
+static SAM::PathResult solve_path(const Design& X, const py::array_t<double, py::array::c_style | py::array::forcecast>& y, const py::array_t<double, py::array::c_style | py::array::forcecast>& lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace& ws, const SAM::GroupTransform* transform) {
+  if (y.size() != X.n)
+    throw py::value_error("y and X disagree on the number of samples");
+  vector<double> ll(lambda.data(), lambda.data() + lambda.size());
+  SAM::SolverOptions opt = options;
+  SAM::PathResult out;
+  py::gil_scoped_release release;
+  SAM::grplasso_path(X, y.data(), ll, opt, ws, out, transform);
+  return out;
+}
+
+SAM::PathResult __grplasso_path(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::object X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int p, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform) {
+  SAM::GrpLassoWorkspace local;
+  SAM::GrpLassoWorkspace& ws = workspace ? *workspace : local;
+  WorkspaceLock claim(ws);
+  int n, d, ld;
+  if (is_float32(X)) {
+    py::array_t<float, 0> Xf = py::array_t<float, 0>::ensure(X);
+    float* XX = design_buffer(Xf, n, d, p, ld, ws, true);
+    return solve_path(SAM::DenseDesignF(XX, n, d, p, ld), y, lambda, options, ws, transform);
+  }
+  py::array_t<double> Xd = dense_array(X);
+  double* XX = design_buffer(Xd, n, d, p, ld, ws, true);
+  return solve_path(SAM::DenseDesign(XX, n, d, p, ld), y, lambda, options, ws, transform);
+}
+
+SAM::PathResult __grplasso_path_banded(py::array_t<double, py::array::c_style | py::array::forcecast> y, const SAM::BandedDesign& X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform) {
+  SAM::GrpLassoWorkspace local;
+  SAM::GrpLassoWorkspace& ws = workspace ? *workspace : local;
+  WorkspaceLock claim(ws);
+  return solve_path(X, y, lambda, options, ws, transform);
+}
+
+SAM::PathResult __grplasso_path_banded_f32(py::array_t<double, py::array::c_style | py::array::forcecast> y, const SAM::BandedDesignF& X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform) {
+  SAM::GrpLassoWorkspace local;
+  SAM::GrpLassoWorkspace& ws = workspace ? *workspace : local;
+  WorkspaceLock claim(ws);
+  return solve_path(X, y, lambda, options, ws, transform);
+}
+
+SAM::PathResult __grplasso_path_binned(py::array_t<double, py::array::c_style | py::array::forcecast> y, const SAM::BinnedDesign& X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform) {
+  SAM::GrpLassoWorkspace local;
+  SAM::GrpLassoWorkspace& ws = workspace ? *workspace : local;
+  WorkspaceLock claim(ws);
+  return solve_path(X, y, lambda, options, ws, transform);
+}
+
+// initial_folds = 0 runs plain K-fold CV, otherwise successive halving.
+template <class T>
+static SAM::CVResult cv_path(const SAM::DenseDesignT<T>& X, const py::array_t<double, py::array::c_style | py::array::forcecast>& y, const py::array_t<int, py::array::c_style | py::array::forcecast>& folds, const py::array_t<double, py::array::c_style | py::array::forcecast>& lambda, const SAM::SolverOptions& options, int initial_folds = 0, double z = 0) {
+  if (y.size() != X.n || folds.size() != X.n)
+    throw py::value_error("y, folds and X disagree on the number of samples");
+  vector<int> ff(folds.data(), folds.data() + folds.size());
+  vector<double> ll(lambda.data(), lambda.data() + lambda.size());
+  SAM::SolverOptions opt = options;
+  SAM::CVResult out;
+  py::gil_scoped_release release;
+  if (initial_folds > 0)
+    SAM::cv_grplasso_halving(X, y.data(), ff, ll, opt, initial_folds, z, out);
+  else
+    SAM::cv_grplasso(X, y.data(), ff, ll, opt, out);
+  return out;
+}
+
+SAM::CVResult __cv_grplasso(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::object X, py::array_t<int, py::array::c_style | py::array::forcecast> folds, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int p, const SAM::SolverOptions& options) {
+  // Every fold reads its training rows from this one buffer.
+  SAM::GrpLassoWorkspace ws;
+  int n, d, ld;
+  if (is_float32(X)) {
+    py::array_t<float, 0> Xf = py::array_t<float, 0>::ensure(X);
+    float* XX = design_buffer(Xf, n, d, p, ld, ws, true);
+    return cv_path(SAM::DenseDesignF(XX, n, d, p, ld), y, folds, lambda, options);
+  }
+  py::array_t<double> Xd = dense_array(X);
+  double* XX = design_buffer(Xd, n, d, p, ld, ws, true);
+  return cv_path(SAM::DenseDesign(XX, n, d, p, ld), y, folds, lambda, options);
+}
+
+SAM::CVResult __cv_grplasso_halving(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::object X, py::array_t<int, py::array::c_style | py::array::forcecast> folds, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int p, const SAM::SolverOptions& options, int initial_folds, double z) {
+  if (initial_folds < 2)
+    throw py::value_error("initial_folds must be at least 2");
+  SAM::GrpLassoWorkspace ws;
+  int n, d, ld;
+  if (is_float32(X)) {
+    py::array_t<float, 0> Xf = py::array_t<float, 0>::ensure(X);
+    float* XX = design_buffer(Xf, n, d, p, ld, ws, true);
+    return cv_path(SAM::DenseDesignF(XX, n, d, p, ld), y, folds, lambda, options, initial_folds, z);
+  }
+  py::array_t<double> Xd = dense_array(X);
+  double* XX = design_buffer(Xd, n, d, p, ld, ws, true);
+  return cv_path(SAM::DenseDesign(XX, n, d, p, ld), y, folds, lambda, options, initial_folds, z);
+}
+
+SAM::GroupTransform __group_transform(py::object X, int p, bool center) {
+  SAM::GrpLassoWorkspace ws;
+  int n, d, ld;
+  SAM::GroupTransform tf;
+  if (is_float32(X)) {
+    py::array_t<float, 0> Xf = py::array_t<float, 0>::ensure(X);
+    float* XX = design_buffer(Xf, n, d, p, ld, ws, true);
+    py::gil_scoped_release release;
+    tf.fit(SAM::DenseDesignF(XX, n, d, p, ld), center);
+    return tf;
+  }
+  py::array_t<double> Xd = dense_array(X);
+  double* XX = design_buffer(Xd, n, d, p, ld, ws, true);
+  py::gil_scoped_release release;
+  tf.fit(SAM::DenseDesign(XX, n, d, p, ld), center);
+  return tf;
+}
+
+SAM::GroupTransform __group_transform_banded(const SAM::BandedDesign& X, bool center) {
+  SAM::GroupTransform tf;
+  py::gil_scoped_release release;
+  tf.fit(X, center);
+  return tf;
+}
+
+SAM::GroupTransform __group_transform_banded_f32(const SAM::BandedDesignF& X, bool center) {
+  SAM::GroupTransform tf;
+  py::gil_scoped_release release;
+  tf.fit(X, center);
+  return tf;
+}
+
+SAM::GroupTransform __group_transform_binned(const SAM::BinnedDesign& X, bool center) {
+  SAM::GroupTransform tf;
+  py::gil_scoped_release release;
+  tf.fit(X, center);
+  return tf;
+}
+
+template <class T>
+static py::array_t<T> aligned_design(int n, int d, int p) {
+  int ld = SAM::padded_stride(n, sizeof(T));
+  size_t count = (size_t)ld * d * p;
+  T* buf = reinterpret_cast<T*>(SAM::aligned_alloc_doubles((count * sizeof(T) + sizeof(double) - 1) / sizeof(double), false));
+  std::fill(buf, buf + count, T(0));
+  py::capsule owner(buf, [](void* ptr) { SAM::aligned_free(ptr); });
+  const ssize_t sz = sizeof(T);
+  return py::array_t<T>({(ssize_t)n, (ssize_t)d * p}, {sz, sz * ld}, buf, owner);
+}
+
+py::array __aligned_design(int n, int d, int p, bool single) {
+  if (n < 1 || d < 1 || p < 1)
+    throw py::value_error("n, d and p must be positive");
+  if (single)
+    return aligned_design<float>(n, d, p);
+  return aligned_design<double>(n, d, p);
+}
+
+py::array_t<double> __bspline_knots(py::array_t<double, py::array::f_style | py::array::forcecast> X, int p, int degree) {
+  if (X.ndim() != 2 || X.shape(0) < 1)
+    throw py::value_error("X must be a non-empty (n, d) matrix");
+  if (degree < 0 || p < degree + 1)
+    throw py::value_error("p must be at least degree + 1");
+  int n = X.shape(0), d = X.shape(1), nknots = p + degree + 1;
+  py::array_t<double> knots({d, nknots});
+  SAM::bspline_knots(X.data(), n, d, p, degree, knots.mutable_data());
+  return knots;
+}
+
+template <class T>
+static py::array_t<T> basis_array(const double* x, int n, int d, const double* knots, int nknots, int degree) {
+  int p = nknots - degree - 1;
+  const ssize_t sz = sizeof(T);
+  py::array_t<T> out({(ssize_t)n, (ssize_t)d * p}, {sz, sz * n});
+  T* data = out.mutable_data();
+  {
+    py::gil_scoped_release release;
+    SAM::bspline_basis(x, n, d, knots, nknots, degree, data);
+  }
+  return out;
+}
+
+py::array __bspline_basis(py::array_t<double, py::array::f_style | py::array::forcecast> X, py::array_t<double, py::array::c_style | py::array::forcecast> knots, int degree, bool single) {
+  // The result is a Fortran-ordered (n, d*p) matrix, i.e. the solver's
+  // layout, so it can go to __grplasso_path without another copy. With
+  // `single` it is float32.
+  if (X.ndim() != 2)
+    throw py::value_error("X must be an (n, d) matrix");
+  int n = X.shape(0), d = X.shape(1);
+  if (knots.ndim() != 2 || knots.shape(0) != d)
+    throw py::value_error("knots must be a (d, nknots) matrix");
+  int nknots = knots.shape(1), p = nknots - degree - 1;
+  if (degree < 0 || p < degree + 1)
+    throw py::value_error("too few knots for the spline degree");
+  if (single)
+    return basis_array<float>(X.data(), n, d, knots.data(), nknots, degree);
+  return basis_array<double>(X.data(), n, d, knots.data(), nknots, degree);
+}
+
+py::object __bspline_banded(py::array_t<double, py::array::f_style | py::array::forcecast> X, py::array_t<double, py::array::c_style | py::array::forcecast> knots, int degree, bool single) {
+  if (X.ndim() != 2)
+    throw py::value_error("X must be an (n, d) matrix");
+  int n = X.shape(0), d = X.shape(1);
+  if (knots.ndim() != 2 || knots.shape(0) != d)
+    throw py::value_error("knots must be a (d, nknots) matrix");
+  int nknots = knots.shape(1);
+  if (degree < 0 || nknots - degree - 1 < degree + 1)
+    throw py::value_error("too few knots for the spline degree");
+  if (single) {
+    SAM::BandedDesignF out;
+    {
+      py::gil_scoped_release release;
+      SAM::bspline_banded(X.data(), n, d, knots.data(), nknots, degree, out);
+    }
+    return py::cast(std::move(out));
+  }
+  SAM::BandedDesign out;
+  {
+    py::gil_scoped_release release;
+    SAM::bspline_banded(X.data(), n, d, knots.data(), nknots, degree, out);
+  }
+  return py::cast(std::move(out));
+}
+
+template <class T>
+py::array_t<double> __banded_to_dense(const SAM::BandedDesignT<T>& X) {
+  const ssize_t sz = sizeof(double);
+  py::array_t<double> out({(ssize_t)X.n, (ssize_t)X.d * X.p}, {sz, sz * X.n});
+  X.to_dense(out.mutable_data());
+  return out;
+}
+
+template py::array_t<double> __banded_to_dense<double>(const SAM::BandedDesign&);
+template py::array_t<double> __banded_to_dense<float>(const SAM::BandedDesignF&);
+
+SAM::BinnedDesign __bspline_binned(py::array_t<double, py::array::f_style | py::array::forcecast> X, py::array_t<double, py::array::c_style | py::array::forcecast> knots, int degree, int max_bins) {
+  if (X.ndim() != 2)
+    throw py::value_error("X must be an (n, d) matrix");
+  int n = X.shape(0), d = X.shape(1);
+  if (knots.ndim() != 2 || knots.shape(0) != d)
+    throw py::value_error("knots must be a (d, nknots) matrix");
+  int nknots = knots.shape(1);
+  if (degree < 0 || nknots - degree - 1 < degree + 1)
+    throw py::value_error("too few knots for the spline degree");
+  if (max_bins < 1 || max_bins > SAM::kMaxBins)
+    throw py::value_error("max_bins must be between 1 and 256");
+  SAM::BinnedDesign out;
+  py::gil_scoped_release release;
+  SAM::bspline_binned(X.data(), n, d, knots.data(), nknots, degree, max_bins, out);
+  return out;
+}
+
+py::array_t<double> __binned_to_dense(const SAM::BinnedDesign& X) {
+  const ssize_t sz = sizeof(double);
+  py::array_t<double> out({(ssize_t)X.n, (ssize_t)X.d * X.p}, {sz, sz * X.n});
+  X.to_dense(out.mutable_data());
+  return out;
+}
+
 void __grpLR(vector<vector<vector<double>>> A, vector<double> y, vector<double> lambda, int nlambda, double L0, int n, int d, int p, double x, double a0, int max_ite, double thol, string regfunc, double alpha, double z, int df, double func_norm) {
 
 }
@@ -3,12 +3,57 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include "workspace.h"
+#include "banded.h"
+#include "binned.h"
+#include "solver.h"
+#include "cv.h"
+namespace py = pybind11;
 using std::vector;
 using std::string;
 using std::tuple;
 
 
-tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso(vector<double> y, vector<vector<vector<double>>> X, vector<double> lambda, int max_ite, double thol, string regfunc, int input);
+void __workspace_reserve(SAM::GrpLassoWorkspace& ws, int n, int d, int p, bool with_design, bool single);
 
+tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso(vector<double> y, vector<vector<vector<double>>> X, vector<double> lambda, int max_ite, double thol, string regfunc, int input, SAM::GrpLassoWorkspace* workspace);
+
+tuple<vector<int>, vector<double>, vector<double>, vector<double>> __grplasso_array(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::array_t<double> X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int max_ite, double thol, string regfunc, int input, int p, SAM::GrpLassoWorkspace* workspace);
+
+SAM::PathResult __grplasso_path(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::object X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int p, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform);
+
+SAM::PathResult __grplasso_path_banded(py::array_t<double, py::array::c_style | py::array::forcecast> y, const SAM::BandedDesign& X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform);
+
+SAM::PathResult __grplasso_path_banded_f32(py::array_t<double, py::array::c_style | py::array::forcecast> y, const SAM::BandedDesignF& X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform);
+
+SAM::PathResult __grplasso_path_binned(py::array_t<double, py::array::c_style | py::array::forcecast> y, const SAM::BinnedDesign& X, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, const SAM::SolverOptions& options, SAM::GrpLassoWorkspace* workspace, const SAM::GroupTransform* transform);
+
+SAM::CVResult __cv_grplasso(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::object X, py::array_t<int, py::array::c_style | py::array::forcecast> folds, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int p, const SAM::SolverOptions& options);
+
+SAM::CVResult __cv_grplasso_halving(py::array_t<double, py::array::c_style | py::array::forcecast> y, py::object X, py::array_t<int, py::array::c_style | py::array::forcecast> folds, py::array_t<double, py::array::c_style | py::array::forcecast> lambda, int p, const SAM::SolverOptions& options, int initial_folds, double z);
+
+SAM::GroupTransform __group_transform(py::object X, int p, bool center);
+
+SAM::GroupTransform __group_transform_banded(const SAM::BandedDesign& X, bool center);
+
+SAM::GroupTransform __group_transform_banded_f32(const SAM::BandedDesignF& X, bool center);
+
+SAM::GroupTransform __group_transform_binned(const SAM::BinnedDesign& X, bool center);
+
+py::array __aligned_design(int n, int d, int p, bool single);
+
+py::array_t<double> __bspline_knots(py::array_t<double, py::array::f_style | py::array::forcecast> X, int p, int degree);
+
+py::array __bspline_basis(py::array_t<double, py::array::f_style | py::array::forcecast> X, py::array_t<double, py::array::c_style | py::array::forcecast> knots, int degree, bool single);
+
+py::object __bspline_banded(py::array_t<double, py::array::f_style | py::array::forcecast> X, py::array_t<double, py::array::c_style | py::array::forcecast> knots, int degree, bool single);
+
+template <class T>
+py::array_t<double> __banded_to_dense(const SAM::BandedDesignT<T>& X);
+
+SAM::BinnedDesign __bspline_binned(py::array_t<double, py::array::f_style | py::array::forcecast> X, py::array_t<double, py::array::c_style | py::array::forcecast> knots, int degree, int max_bins);
+
+py::array_t<double> __binned_to_dense(const SAM::BinnedDesign& X);
 
 #endif
@@ -0,0 +1,239 @@
+#include "cv.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include "kernels.h"
+#include "ortho.h"
+#include "thread_pool.h"
+
+namespace SAM {
+  // Held-out mean squared error of every lambda of a fold fit, predicting
+  // with the fit's own intercept.
+  template <class T>
+  static void held_out_loss(const DenseDesignT<T>& X, const double* y, const vector<int>& rows, const PathResult& fit, double* loss) {
+    size_t m = (size_t)X.d * X.p;
+    int nout = rows.size();
+    vector<double> pred(nout);
+    for (int l = 0; l < fit.nlambda; l++) {
+      const double* w = &fit.w[l * m];
+      std::fill(pred.begin(), pred.end(), fit.intercept[l]);
+      for (size_t c = 0; c < m; c++) {
+        if (w[c] == 0)
+          continue;
+        const T* col = X.X + c * X.ld;
+        for (int a = 0; a < nout; a++)
+          pred[a] += col[rows[a]] * w[c];
+      }
+      double acc = 0;
+      for (int a = 0; a < nout; a++)
+        acc += (y[rows[a]] - pred[a]) * (y[rows[a]] - pred[a]);
+      loss[l] = acc / nout;
+    }
+  }
+
+  // Everything a fold fit needs, shared by the plain and the successive
+  // halving drivers.
+  template <class T>
+  struct FoldFitter {
+    const DenseDesignT<T>& X;
+    const double* y;
+    vector<vector<int> > train, test;
+    SolverOptions opt;
+    const PathResult& path;
+    std::function<const double*(int)> full_column;
+    bool downdate;
+
+    FoldFitter(const DenseDesignT<T>& X, const double* y, int K, const vector<int>& folds, const SolverOptions& opt, const PathResult& path, std::function<const double*(int)> full_column, bool downdate)
+      : X(X), y(y), train(K), test(K), opt(opt), path(path), full_column(full_column), downdate(downdate) {
+      for (int i = 0; i < X.n; i++)
+        for (int f = 0; f < K; f++)
+          (folds[i] == f ? test : train)[f].push_back(i);
+      this->opt.lambda_input = 1;
+    }
+
+    // Held-out losses of fold f at the lambdas listed in idx, written to
+    // loss[idx[a]].
+    void fit(int f, const vector<int>& idx, double* loss) const {
+      size_t m = (size_t)X.d * X.p;
+      const vector<int>& rows = train[f];
+      int nt = rows.size();
+      RowSubsetDesignT<T> Xf(X, rows.data(), nt);
+      vector<double> yf(nt);
+      for (int i = 0; i < nt; i++)
+        yf[i] = y[rows[i]];
+      GroupTransform tf;
+      tf.fit(Xf, true, opt.orthonormalize);
+
+      vector<double> lambda(idx.size()), warm(idx.size() * m), sub(idx.size());
+      for (size_t a = 0; a < idx.size(); a++) {
+        lambda[a] = path.lambda[idx[a]];
+        const double* w = path.w.data() + idx[a] * m;
+        std::copy(w, w + m, &warm[a * m]);
+      }
+      RowSubsetDesignT<T> Xout(X, test[f].data(), test[f].size());
+      GramDowndate<RowSubsetDesignT<T> > fold_gram = {full_column, &Xout};
+
+      GrpLassoWorkspace ws;
+      PathResult fit;
+      grplasso_path(Xf, yf.data(), lambda, opt, ws, fit, &tf, warm.data(), downdate ? &fold_gram : NULL);
+      held_out_loss(X, y, test[f], fit, sub.data());
+      for (size_t a = 0; a < idx.size(); a++)
+        loss[idx[a]] = sub[a];
+    }
+  };
+
+  // Shared driver. Folds are evaluated in rounds: the first `initial`
+  // folds, then twice as many in total each round, until all K are done.
+  // Between rounds, a lambda whose losses on the folds so far exceed the
+  // incumbent's (lowest mean) by more than z paired standard errors is
+  // dropped. initial >= K is plain K-fold CV.
+  template <class T>
+  static void run_cv(const DenseDesignT<T>& X, const double* y, const vector<int>& folds, const vector<double>& lambda, const SolverOptions& opt, int initial, double z, CVResult& out) {
+    int n = X.n, nlambda = lambda.size();
+    if ((int)folds.size() != n)
+      throw std::invalid_argument("folds needs one label per row");
+    int K = 0;
+    for (int i = 0; i < n; i++) {
+      if (folds[i] < 0)
+        throw std::invalid_argument("fold labels must be non-negative");
+      K = std::max(K, folds[i] + 1);
+    }
+    if (K < 2)
+      throw std::invalid_argument("cross-validation needs at least two folds");
+    out.fold_size.assign(K, 0);
+    for (int i = 0; i < n; i++)
+      out.fold_size[folds[i]]++;
+    for (int f = 0; f < K; f++)
+      if (out.fold_size[f] == 0)
+        throw std::invalid_argument("every fold needs at least one row");
+
+    // With cv_gram the full-data columns are computed once, by whichever
+    // fit needs them first, and every fold subtracts its held-out rows.
+    bool downdate = opt.cv_gram;
+    SharedGram<DenseDesignT<T> > shared(X);
+    std::function<const double*(int)> full_column = [&shared](int j) { return shared.column(j); };
+    GramDowndate<DenseDesignT<T> > full_gram = {full_column, NULL};
+
+    // Every fit, the full-data one included, centers X and y on its own
+    // rows (and orthonormalizes with opt.orthonormalize), so all of them
+    // solve the same problem with a free intercept.
+    GroupTransform tf;
+    tf.fit(X, true, opt.orthonormalize);
+    GrpLassoWorkspace ws;
+    grplasso_path(X, y, lambda, opt, ws, out.path, &tf, NULL, downdate ? &full_gram : NULL);
+
+    out.nfolds = K, out.nlambda = nlambda;
+    out.lambda = out.path.lambda;
+    out.fold_loss.assign((size_t)K * nlambda, std::numeric_limits<double>::quiet_NaN());
+    out.folds_used.assign(nlambda, 0);
+    out.pruned_round.assign(nlambda, -1);
+    out.prune_z.assign(nlambda, std::numeric_limits<double>::quiet_NaN());
+    out.round_folds.clear();
+    FoldFitter<T> fitter(X, y, K, folds, opt, out.path, full_column, downdate);
+
+    vector<int> alive(nlambda);
+    for (int l = 0; l < nlambda; l++)
+      alive[l] = l;
+    int done = 0;
+    for (int round = 0; done < K; round++) {
+      int end = std::min(K, round == 0 ? std::max(initial, 2) : 2 * done);
+      parallel_for(end - done, [&](int a) {
+        int f = done + a;
+        fitter.fit(f, alive, &out.fold_loss[(size_t)f * nlambda]);
+      });
+      done = end;
+      for (int l : alive)
+        out.folds_used[l] = done;
+      out.round_folds.push_back(done);
+      if (done == K || alive.size() < 2)
+        continue;
+
+      // Paired comparison with the incumbent over the folds seen so far.
+      int best = alive[0];
+      vector<double> mean(nlambda, 0.0);
+      for (int l : alive) {
+        for (int f = 0; f < done; f++)
+          mean[l] += out.fold_loss[(size_t)f * nlambda + l] / done;
+        if (mean[l] < mean[best])
+          best = l;
+      }
+      vector<int> kept;
+      for (int l : alive) {
+        if (l == best) {
+          kept.push_back(l);
+          continue;
+        }
+        double dm = mean[l] - mean[best], var = 0;
+        for (int f = 0; f < done; f++) {
+          double dev = out.fold_loss[(size_t)f * nlambda + l] - out.fold_loss[(size_t)f * nlambda + best] - dm;
+          var += dev * dev / (done - 1);
+        }
+        double se = std::sqrt(var / done);
+        double score = se > 0 ? dm / se : (dm > 0 ? std::numeric_limits<double>::infinity() : 0);
+        if (score > z) {
+          out.pruned_round[l] = round;
+          out.prune_z[l] = score;
+        } else {
+          kept.push_back(l);
+        }
+      }
+      alive.swap(kept);
+    }
+    out.gram_columns = shared.cached();
+
+    // Fold losses weighted by fold size, as if every row were scored once,
+    // over the folds each lambda was evaluated on.
+    out.cvm.assign(nlambda, 0.0);
+    out.cvsd.assign(nlambda, 0.0);
+    for (int l = 0; l < nlambda; l++) {
+      int used = out.folds_used[l];
+      double rows = 0, var = 0;
+      for (int f = 0; f < used; f++) {
+        rows += out.fold_size[f];
+        out.cvm[l] += out.fold_size[f] * out.fold_loss[(size_t)f * nlambda + l];
+      }
+      out.cvm[l] /= rows;
+      for (int f = 0; f < used; f++) {
+        double dev = out.fold_loss[(size_t)f * nlambda + l] - out.cvm[l];
+        var += out.fold_size[f] * dev * dev / rows;
+      }
+      out.cvsd[l] = std::sqrt(var / (used - 1));
+    }
+
+    // Only lambdas seen on every fold compete.
+    out.index_min = out.index_1se = -1;
+    for (int l = 0; l < nlambda; l++)
+      if (out.folds_used[l] == K && (out.index_min < 0 || out.cvm[l] < out.cvm[out.index_min]))
+        out.index_min = l;
+    out.index_1se = out.index_min;
+    if (out.index_min >= 0) {
+      double bound = out.cvm[out.index_min] + out.cvsd[out.index_min];
+      for (int l = 0; l < nlambda; l++)
+        if (out.folds_used[l] == K && out.cvm[l] <= bound && out.lambda[l] > out.lambda[out.index_1se])
+          out.index_1se = l;
+    }
+    out.lambda_min = out.index_min >= 0 ? out.lambda[out.index_min] : 0;
+    out.lambda_1se = out.index_1se >= 0 ? out.lambda[out.index_1se] : 0;
+  }
+
+  template <class T>
+  void cv_grplasso(const DenseDesignT<T>& X, const double* y, const vector<int>& folds, const vector<double>& lambda, const SolverOptions& opt, CVResult& out) {
+    run_cv(X, y, folds, lambda, opt, std::numeric_limits<int>::max(), 0, out);
+  }
+
+  template <class T>
+  void cv_grplasso_halving(const DenseDesignT<T>& X, const double* y, const vector<int>& folds, const vector<double>& lambda, const SolverOptions& opt, int initial_folds, double z, CVResult& out) {
+    if (initial_folds < 2)
+      throw std::invalid_argument("successive halving needs initial_folds >= 2");
+    if (!(z > 0))
+      throw std::invalid_argument("z must be positive");
+    run_cv(X, y, folds, lambda, opt, initial_folds, z, out);
+  }
+
+  template void cv_grplasso<double>(const DenseDesign&, const double*, const vector<int>&, const vector<double>&, const SolverOptions&, CVResult&);
+  template void cv_grplasso<float>(const DenseDesignF&, const double*, const vector<int>&, const vector<double>&, const SolverOptions&, CVResult&);
+  template void cv_grplasso_halving<double>(const DenseDesign&, const double*, const vector<int>&, const vector<double>&, const SolverOptions&, int, double, CVResult&);
+  template void cv_grplasso_halving<float>(const DenseDesignF&, const double*, const vector<int>&, const vector<double>&, const SolverOptions&, int, double, CVResult&);
+}
@@ -0,0 +1,59 @@
+#ifndef CV_H
+#define CV_H
+
+#include <vector>
+#include "design.h"
+#include "gram.h"
+#include "solver.h"
+using std::vector;
+
+namespace SAM {
+  // K-fold cross-validation of the squared-loss path.
+  struct CVResult {
+    int nfolds, nlambda;
+    vector<double> lambda;     // lambda actually used
+    vector<double> cvm;        // held-out mean squared error per lambda
+    vector<double> cvsd;       // its standard error across folds
+    vector<double> fold_loss;  // per fold, [f*nlambda + l]
+    vector<int> fold_size;     // held-out rows per fold
+    int index_min, index_1se;
+    double lambda_min, lambda_1se;
+    int gram_columns;          // full-data Gram columns shared with the folds
+    // Successive halving: folds each lambda was evaluated on (the first
+    // folds_used[l]; unevaluated fold_loss entries are NaN), the round that
+    // pruned it (-1 if it survived) with its z score then, and the folds
+    // done after each round.
+    vector<int> folds_used;
+    vector<int> pruned_round;
+    vector<double> prune_z;
+    vector<int> round_folds;
+    PathResult path;           // fit on all rows
+  };
+
+  // folds[i] in [0, K) puts row i in the held-out set of that fold; K is the
+  // largest label plus one and must be at least 2, with no empty fold.
+  //
+  // The full-data path comes first and fixes the lambdas. Each fold then
+  // solves on its training rows, read in place through a RowSubsetDesign,
+  // starting every lambda from the full-data solution; folds run on the
+  // thread pool. Every fit centers X and y on its own rows, so the model is
+  // intercept + x^T w throughout (path.intercept for the full-data fit). In
+  // covariance mode (with cv_gram) the folds downdate the full-data Gram
+  // columns instead of computing their own. lambda_min minimizes cvm, and
+  // lambda_1se is the largest lambda whose cvm is within one standard error
+  // of it.
+  template <class T>
+  void cv_grplasso(const DenseDesignT<T>& X, const double* y, const vector<int>& folds, const vector<double>& lambda, const SolverOptions& opt, CVResult& out);
+
+  // Successive-halving CV: the grid is first scored on initial_folds folds,
+  // then on twice as many folds each round until all K are used. After each
+  // round a lambda whose fold losses exceed the incumbent's (the lowest
+  // mean so far) by more than z standard errors of the paired differences
+  // is pruned, and later folds fit only the survivors. cvm and cvsd of a
+  // pruned lambda cover the folds it saw; lambda_min and lambda_1se come
+  // from the survivors.
+  template <class T>
+  void cv_grplasso_halving(const DenseDesignT<T>& X, const double* y, const vector<int>& folds, const vector<double>& lambda, const SolverOptions& opt, int initial_folds, double z, CVResult& out);
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "design.h"
+#include <vector>
+#include "kernels.h"
+
+using std::vector;
+
+namespace SAM {
+  template <class T>
+  void DenseDesignT<T>::xtr(int j, const double* r, double* out) const {
+    const T* Xj = X + (size_t)j * p * ld;
+    for (int k = 0; k < p; k++)
+      out[k] = dot(Xj + (size_t)k * ld, r, n);
+  }
+
+  template <class T>
+  void DenseDesignT<T>::axpy(int j, const double* delta, double* r) const {
+    const T* Xj = X + (size_t)j * p * ld;
+    for (int k = 0; k < p; k++)
+      if (delta[k] != 0)
+        sub_scaled(delta[k], Xj + (size_t)k * ld, r, n);
+  }
+
+  template <class T>
+  void DenseDesignT<T>::gram(int j, double* out) const {
+    const T* Xj = X + (size_t)j * p * ld;
+    for (int k = 0; k < p; k++)
+      for (int l = 0; l <= k; l++)
+        out[k * p + l] = out[l * p + k] = dot(Xj + (size_t)k * ld, Xj + (size_t)l * ld, n);
+  }
+
+  template <class T>
+  bool DenseDesignT<T>::aligned() const {
+    return (size_t)X % kAlignment == 0 && (ld * sizeof(T)) % kAlignment == 0;
+  }
+
+  // Copies columns k0 .. k0+m-1 of group j at the listed rows into a
+  // per-thread buffer, column c at c*n, so the subset kernels run through
+  // the selected kernel table like the dense ones. CV folds solve
+  // concurrently on the pool, hence one buffer per thread.
+  template <class T>
+  static const T* gather(const RowSubsetDesignT<T>& S, int j, int k0, int m) {
+    static thread_local vector<T> buf;
+    if (buf.size() < (size_t)m * S.n)
+      buf.resize((size_t)m * S.n);
+    for (int c = 0; c < m; c++) {
+      const T* col = S.X.X + ((size_t)j * S.p + k0 + c) * S.X.ld;
+      T* out = &buf[(size_t)c * S.n];
+      for (int i = 0; i < S.n; i++)
+        out[i] = col[S.rows[i]];
+    }
+    return buf.data();
+  }
+
+  template <class T>
+  void RowSubsetDesignT<T>::xtr(int j, const double* r, double* out) const {
+    const T* Xj = gather(*this, j, 0, p);
+    for (int k = 0; k < p; k++)
+      out[k] = dot(Xj + (size_t)k * n, r, n);
+  }
+
+  template <class T>
+  void RowSubsetDesignT<T>::axpy(int j, const double* delta, double* r) const {
+    for (int k = 0; k < p; k++)
+      if (delta[k] != 0)
+        sub_scaled(delta[k], gather(*this, j, k, 1), r, n);
+  }
+
+  template <class T>
+  void RowSubsetDesignT<T>::gram(int j, double* out) const {
+    const T* Xj = gather(*this, j, 0, p);
+    for (int k = 0; k < p; k++)
+      for (int l = 0; l <= k; l++)
+        out[k * p + l] = out[l * p + k] = dot(Xj + (size_t)k * n, Xj + (size_t)l * n, n);
+  }
+
+  template class DenseDesignT<double>;
+  template class DenseDesignT<float>;
+  template class RowSubsetDesignT<double>;
+  template class RowSubsetDesignT<float>;
+}
@@ -0,0 +1,63 @@
+#ifndef DESIGN_H
+#define DESIGN_H
+
+#include <cstddef>
+#include "workspace.h"
+
+namespace SAM {
+  // Dense design in the solver's j*p*ld + k*ld + i layout, borrowed from the
+  // caller (a NumPy buffer or a GrpLassoWorkspace). The column stride ld
+  // defaults to n; padded_stride(n, sizeof(T)) on a kAlignment-aligned
+  // buffer makes every column start on a cache line, so the vector loads
+  // never straddle two. The element type T is the storage type only: float
+  // halves the footprint and memory traffic, while residuals, coefficients
+  // and every accumulation stay double.
+  //
+  // Every design (DenseDesign, BandedDesign, BinnedDesign) offers the same
+  // group kernels, which is all the path solver needs:
+  //   xtr(j, r, out)      out = X_j^T r
+  //   axpy(j, delta, r)   r -= X_j delta
+  //   gram(j, out)        out = X_j^T X_j, p x p column-major
+  template <class T>
+  class DenseDesignT {
+  public:
+    DenseDesignT(const T* X, int n, int d, int p, int ld = 0) : X(X), n(n), d(d), p(p), ld(ld > 0 ? ld : n) {}
+
+    void xtr(int j, const double* r, double* out) const;
+    void axpy(int j, const double* delta, double* r) const;
+    void gram(int j, double* out) const;
+
+    // Whether every column starts on a kAlignment boundary.
+    bool aligned() const;
+
+    const T* X;
+    int n, d, p, ld;
+  };
+
+  typedef DenseDesignT<double> DenseDesign;
+  typedef DenseDesignT<float> DenseDesignF;
+
+  // The rows listed in `rows` (n of them, increasing) of a dense design,
+  // read in place: CV folds share one design buffer instead of copying
+  // their training rows. Each kernel call gathers the group's rows into
+  // per-thread scratch and runs the dense kernels on it. Vectors the
+  // kernels take or fill (r) have one entry per listed row.
+  template <class T>
+  class RowSubsetDesignT {
+  public:
+    RowSubsetDesignT(const DenseDesignT<T>& X, const int* rows, int n) : X(X), rows(rows), n(n), d(X.d), p(X.p) {}
+
+    void xtr(int j, const double* r, double* out) const;
+    void axpy(int j, const double* delta, double* r) const;
+    void gram(int j, double* out) const;
+
+    const DenseDesignT<T>& X;
+    const int* rows;
+    int n, d, p;
+  };
+
+  typedef RowSubsetDesignT<double> RowSubsetDesign;
+  typedef RowSubsetDesignT<float> RowSubsetDesignF;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "gram.h"
+#include <algorithm>
+#include "kernels.h"
+#include "design.h"
+#include "banded.h"
+#include "binned.h"
+#include "ortho.h"
+
+namespace SAM {
+  // Largest cache the auto mode accepts, in bytes.
+  static const double kMaxCacheBytes = 1 << 30;
+
+  bool use_covariance(int n, int d, int p) {
+    double m = (double)d * p;
+    return n >= 4 * m && m * m * sizeof(double) <= kMaxCacheBytes;
+  }
+
+  // col = X^T X_j, column-major (d*p) x p; e (n) and g (p) are scratch.
+  template <class Design>
+  static void gram_column(const Design& X, int j, double* col, double* e, double* g) {
+    int d = X.d, p = X.p;
+    size_t m = (size_t)d * p;
+    vector<double> unit(p, 0.0);
+    for (int l = 0; l < p; l++) {
+      // e = -X_j e_l, then X_k^T e = -(X^T X_j)_{k, l} for every group k.
+      std::fill(e, e + X.n, 0.0);
+      unit[l] = 1;
+      X.axpy(j, unit.data(), e);
+      unit[l] = 0;
+      for (int k = 0; k < d; k++) {
+        X.xtr(k, e, g);
+        for (int q = 0; q < p; q++)
+          col[l * m + (size_t)k * p + q] = -g[q];
+      }
+    }
+  }
+
+  template <class Design>
+  GramCache<Design>::GramCache(const Design& X, const GramDowndate<Design>* base)
+    : X(X), n(X.n), d(X.d), p(X.p), base(base), cols(X.d), ptrs(X.d, NULL),
+      e(base && base->held_out ? base->held_out->n : X.n), g(X.p), ncached(0) {}
+
+  template <class Design>
+  const double* GramCache<Design>::column(int j) {
+    if (ptrs[j])
+      return ptrs[j];
+    size_t m = (size_t)d * p;
+    ncached++;
+    if (base && !base->held_out)
+      return ptrs[j] = base->full(j);
+    vector<double>& col = cols[j];
+    col.resize(m * p);
+    if (!base) {
+      gram_column(X, j, col.data(), e.data(), g.data());
+      return ptrs[j] = col.data();
+    }
+    // Downdate: the full-data column minus the held-out rows' one.
+    gram_column(*base->held_out, j, col.data(), e.data(), g.data());
+    const double* full = base->full(j);
+    for (size_t a = 0; a < m * p; a++)
+      col[a] = full[a] - col[a];
+    return ptrs[j] = col.data();
+  }
+
+  template <class Design>
+  void GramCache<Design>::downdate(int j, const double* delta, double* c) {
+    const double* col = column(j);
+    size_t m = (size_t)d * p;
+    for (int l = 0; l < p; l++)
+      if (delta[l] != 0)
+        sub_scaled(delta[l], col + l * m, c, m);
+  }
+
+  template <class Design>
+  size_t GramCache<Design>::nbytes() const {
+    return (size_t)ncached * d * p * p * sizeof(double);
+  }
+
+  template <class Design>
+  SharedGram<Design>::SharedGram(const Design& X)
+    : X(X), n(X.n), d(X.d), p(X.p), cols(X.d), once(new std::once_flag[X.d]), ncached(0) {}
+
+  template <class Design>
+  const double* SharedGram<Design>::column(int j) {
+    std::call_once(once[j], [this, j]() {
+      vector<double> e(n), g(p);
+      cols[j].resize((size_t)d * p * p);
+      gram_column(X, j, cols[j].data(), e.data(), g.data());
+      ncached++;
+    });
+    return cols[j].data();
+  }
+
+  template class SharedGram<DenseDesign>;
+  template class SharedGram<DenseDesignF>;
+  template class GramCache<DenseDesign>;
+  template class GramCache<DenseDesignF>;
+  template class GramCache<BandedDesign>;
+  template class GramCache<BandedDesignF>;
+  template class GramCache<BinnedDesign>;
+  template class GramCache<RowSubsetDesign>;
+  template class GramCache<RowSubsetDesignF>;
+  template class GramCache<OrthoDesign<DenseDesign> >;
+  template class GramCache<OrthoDesign<DenseDesignF> >;
+  template class GramCache<OrthoDesign<BandedDesign> >;
+  template class GramCache<OrthoDesign<BandedDesignF> >;
+  template class GramCache<OrthoDesign<BinnedDesign> >;
+  template class GramCache<OrthoDesign<RowSubsetDesign> >;
+  template class GramCache<OrthoDesign<RowSubsetDesignF> >;
+}
@@ -0,0 +1,82 @@
+#ifndef GRAM_H
+#define GRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+using std::vector;
+
+namespace SAM {
+  // Where a GramCache takes its columns from instead of computing them on
+  // its own rows: `full` returns the column X^T X_j of a larger design
+  // sharing these groups (e.g. a SharedGram over all rows), and `held_out`,
+  // when set, holds the rows of that design this one lacks. A CV fold's
+  // column is then the full-data one minus the held-out rows' contribution,
+  // which touches n/K rows instead of n (K-1)/K.
+  template <class Design>
+  struct GramDowndate {
+    std::function<const double*(int)> full;
+    const Design* held_out;
+  };
+
+  // Lazily filled cross-Gram blocks for covariance updates. The column block
+  // X^T X_j of group j, all d*p rows by p columns, is computed the first
+  // time group j moves; after that, keeping X^T r current through a block
+  // update costs O(d*p*p) instead of a pass over the n samples.
+  template <class Design>
+  class GramCache {
+  public:
+    explicit GramCache(const Design& X, const GramDowndate<Design>* base = NULL);
+
+    // X^T X_j, column-major (d*p) x p.
+    const double* column(int j);
+    // c -= X^T X_j delta.
+    void downdate(int j, const double* delta, double* c);
+
+    int cached() const { return ncached; }
+    size_t nbytes() const;
+
+    const Design& X;
+    int n, d, p;
+
+  private:
+    const GramDowndate<Design>* base;
+    vector<vector<double> > cols;
+    vector<const double*> ptrs;
+    vector<double> e, g;
+    int ncached;
+  };
+
+  // Cross-Gram columns of a full design, computed on first use and then
+  // shared read-only between threads: the full-data CV fit and every fold
+  // (through GramDowndate) use the same copy. Each group's column is its own
+  // (d*p) x p block, laid out as GramCache::column returns it; the design's
+  // j*p*ld storage is not involved.
+  template <class Design>
+  class SharedGram {
+  public:
+    explicit SharedGram(const Design& X);
+
+    // X^T X_j, column-major (d*p) x p. Safe to call from several threads.
+    const double* column(int j);
+
+    int cached() const { return ncached; }
+
+    const Design& X;
+    int n, d, p;
+
+  private:
+    vector<vector<double> > cols;
+    std::unique_ptr<std::once_flag[]> once;
+    std::atomic<int> ncached;
+  };
+
+  // Heuristic of the "auto" covariance mode: n large next to d*p, and a
+  // fully populated cache of bounded size.
+  extern bool use_covariance(int n, int d, int p);
+}
+
+#endif
@@ -0,0 +1,369 @@
+#include "kernels.h"
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+// The AVX2 and AVX-512 variants are compiled with per-function target
+// attributes, whatever the target of the rest of the build, and picked at
+// run time. Without GCC-style attributes only the variants the build
+// targets are compiled in.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SAM_TARGET(isa) __attribute__((target(isa)))
+#define SAM_HAVE_AVX2 1
+#define SAM_HAVE_AVX512 1
+#else
+#define SAM_TARGET(isa)
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#if defined(__AVX2__) && defined(__FMA__)
+#define SAM_HAVE_AVX2 1
+#endif
+#if defined(__AVX512F__)
+#define SAM_HAVE_AVX512 1
+#endif
+#endif
+
+#define SAM_AVX2 SAM_TARGET("avx2,fma")
+#define SAM_AVX512 SAM_TARGET("avx512f,avx2,fma")
+
+namespace SAM {
+  namespace scalar {
+    template <class A, class B>
+    static double dot(const A* a, const B* b, int n) {
+      double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+      int i = 0;
+      for (; i + 4 <= n; i += 4) {
+        s0 += (double)a[i] * b[i];
+        s1 += (double)a[i + 1] * b[i + 1];
+        s2 += (double)a[i + 2] * b[i + 2];
+        s3 += (double)a[i + 3] * b[i + 3];
+      }
+      for (; i < n; i++)
+        s0 += (double)a[i] * b[i];
+      return (s0 + s1) + (s2 + s3);
+    }
+
+    template <class X>
+    static void sub_scaled(double alpha, const X* x, double* y, int n) {
+      for (int i = 0; i < n; i++)
+        y[i] -= alpha * (double)x[i];
+    }
+
+    static double group_step(const double* w, const double* g, double c, int p, double* z) {
+      for (int k = 0; k < p; k++)
+        z[k] = w[k] + c * g[k];
+      return std::sqrt(dot(z, z, p));
+    }
+
+    static double group_delta(const double* z, const double* w, double scale, int p, double* delta) {
+      for (int k = 0; k < p; k++)
+        delta[k] = scale * z[k] - w[k];
+      return dot(delta, delta, p);
+    }
+  }
+
+  // The reproducible variant fixes the summation shape (eight interleaved
+  // partial sums, combined pairwise) and never fuses a multiply into an
+  // add, so a binary gives bit-identical results on every CPU it runs on.
+  // Products are separate statements, which keeps compilers that contract
+  // only within an expression from fusing them; GCC needs the pragma.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+  namespace reproducible {
+    static const int kLanes = 8;
+
+    template <class A, class B>
+    static double dot(const A* a, const B* b, int n) {
+      double s[kLanes] = {0};
+      int i = 0;
+      for (; i + kLanes <= n; i += kLanes)
+        for (int l = 0; l < kLanes; l++) {
+          double prod = (double)a[i + l] * b[i + l];
+          s[l] += prod;
+        }
+      for (int l = 0; i < n; i++, l++) {
+        double prod = (double)a[i] * b[i];
+        s[l] += prod;
+      }
+      return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+    }
+
+    template <class X>
+    static void sub_scaled(double alpha, const X* x, double* y, int n) {
+      for (int i = 0; i < n; i++) {
+        double prod = alpha * (double)x[i];
+        y[i] -= prod;
+      }
+    }
+
+    static double group_step(const double* w, const double* g, double c, int p, double* z) {
+      for (int k = 0; k < p; k++) {
+        double step = c * g[k];
+        z[k] = w[k] + step;
+      }
+      return std::sqrt(dot(z, z, p));
+    }
+
+    static double group_delta(const double* z, const double* w, double scale, int p, double* delta) {
+      for (int k = 0; k < p; k++) {
+        double t = scale * z[k];
+        delta[k] = t - w[k];
+      }
+      return dot(delta, delta, p);
+    }
+  }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+#ifdef SAM_HAVE_AVX2
+  namespace avx2 {
+    SAM_AVX2 static inline __m256d load(const double* x) { return _mm256_loadu_pd(x); }
+    SAM_AVX2 static inline __m256d load(const float* x) { return _mm256_cvtps_pd(_mm_loadu_ps(x)); }
+
+    SAM_AVX2 static inline double hsum(__m256d v) {
+      __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+      return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+    template <class A, class B>
+    SAM_AVX2 static double dot(const A* a, const B* b, int n) {
+      __m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+      int i = 0;
+      for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_fmadd_pd(load(a + i), load(b + i), s0);
+        s1 = _mm256_fmadd_pd(load(a + i + 4), load(b + i + 4), s1);
+        s2 = _mm256_fmadd_pd(load(a + i + 8), load(b + i + 8), s2);
+        s3 = _mm256_fmadd_pd(load(a + i + 12), load(b + i + 12), s3);
+      }
+      for (; i + 4 <= n; i += 4)
+        s0 = _mm256_fmadd_pd(load(a + i), load(b + i), s0);
+      double s = hsum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+      for (; i < n; i++)
+        s += (double)a[i] * b[i];
+      return s;
+    }
+
+    template <class X>
+    SAM_AVX2 static void sub_scaled(double alpha, const X* x, double* y, int n) {
+      __m256d a = _mm256_set1_pd(alpha);
+      int i = 0;
+      for (; i + 8 <= n; i += 8) {
+        __m256d y0 = _mm256_fnmadd_pd(a, load(x + i), _mm256_loadu_pd(y + i));
+        __m256d y1 = _mm256_fnmadd_pd(a, load(x + i + 4), _mm256_loadu_pd(y + i + 4));
+        _mm256_storeu_pd(y + i, y0);
+        _mm256_storeu_pd(y + i + 4, y1);
+      }
+      for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(y + i, _mm256_fnmadd_pd(a, load(x + i), _mm256_loadu_pd(y + i)));
+      for (; i < n; i++)
+        y[i] -= alpha * (double)x[i];
+    }
+
+    // Groups are short (p is usually below 16), so one accumulator is
+    // enough here; the point is fusing the update with its norm.
+    SAM_AVX2 static double group_step(const double* w, const double* g, double c, int p, double* z) {
+      __m256d cv = _mm256_set1_pd(c), s = _mm256_setzero_pd();
+      int k = 0;
+      for (; k + 4 <= p; k += 4) {
+        __m256d v = _mm256_fmadd_pd(cv, _mm256_loadu_pd(g + k), _mm256_loadu_pd(w + k));
+        _mm256_storeu_pd(z + k, v);
+        s = _mm256_fmadd_pd(v, v, s);
+      }
+      double acc = hsum(s);
+      for (; k < p; k++) {
+        z[k] = w[k] + c * g[k];
+        acc += z[k] * z[k];
+      }
+      return std::sqrt(acc);
+    }
+
+    SAM_AVX2 static double group_delta(const double* z, const double* w, double scale, int p, double* delta) {
+      __m256d sv = _mm256_set1_pd(scale), s = _mm256_setzero_pd();
+      int k = 0;
+      for (; k + 4 <= p; k += 4) {
+        __m256d v = _mm256_fmsub_pd(sv, _mm256_loadu_pd(z + k), _mm256_loadu_pd(w + k));
+        _mm256_storeu_pd(delta + k, v);
+        s = _mm256_fmadd_pd(v, v, s);
+      }
+      double acc = hsum(s);
+      for (; k < p; k++) {
+        delta[k] = scale * z[k] - w[k];
+        acc += delta[k] * delta[k];
+      }
+      return acc;
+    }
+  }
+#endif
+
+#ifdef SAM_HAVE_AVX512
+  namespace avx512 {
+    SAM_AVX512 static inline __m512d load(const double* x) { return _mm512_loadu_pd(x); }
+    SAM_AVX512 static inline __m512d load(const float* x) { return _mm512_cvtps_pd(_mm256_loadu_ps(x)); }
+
+    template <class A, class B>
+    SAM_AVX512 static double dot(const A* a, const B* b, int n) {
+      __m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+      int i = 0;
+      for (; i + 32 <= n; i += 32) {
+        s0 = _mm512_fmadd_pd(load(a + i), load(b + i), s0);
+        s1 = _mm512_fmadd_pd(load(a + i + 8), load(b + i + 8), s1);
+        s2 = _mm512_fmadd_pd(load(a + i + 16), load(b + i + 16), s2);
+        s3 = _mm512_fmadd_pd(load(a + i + 24), load(b + i + 24), s3);
+      }
+      for (; i + 8 <= n; i += 8)
+        s0 = _mm512_fmadd_pd(load(a + i), load(b + i), s0);
+      double s = _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+      for (; i < n; i++)
+        s += (double)a[i] * b[i];
+      return s;
+    }
+
+    template <class X>
+    SAM_AVX512 static void sub_scaled(double alpha, const X* x, double* y, int n) {
+      __m512d a = _mm512_set1_pd(alpha);
+      int i = 0;
+      for (; i + 16 <= n; i += 16) {
+        __m512d y0 = _mm512_fnmadd_pd(a, load(x + i), _mm512_loadu_pd(y + i));
+        __m512d y1 = _mm512_fnmadd_pd(a, load(x + i + 8), _mm512_loadu_pd(y + i + 8));
+        _mm512_storeu_pd(y + i, y0);
+        _mm512_storeu_pd(y + i + 8, y1);
+      }
+      for (; i + 8 <= n; i += 8)
+        _mm512_storeu_pd(y + i, _mm512_fnmadd_pd(a, load(x + i), _mm512_loadu_pd(y + i)));
+      for (; i < n; i++)
+        y[i] -= alpha * (double)x[i];
+    }
+
+    // 8-wide lanes rarely fill on a group, so the group kernels stay 4-wide.
+    using avx2::group_step;
+    using avx2::group_delta;
+  }
+#endif
+
+  // One complete set of kernels.
+  struct KernelTable {
+    const char* name;
+    double (*dot_dd)(const double*, const double*, int);
+    double (*dot_fd)(const float*, const double*, int);
+    double (*dot_ff)(const float*, const float*, int);
+    void (*sub_scaled_d)(double, const double*, double*, int);
+    void (*sub_scaled_f)(double, const float*, double*, int);
+    double (*group_step)(const double*, const double*, double, int, double*);
+    double (*group_delta)(const double*, const double*, double, int, double*);
+  };
+
+#define SAM_KERNEL_TABLE(ns)                                             \
+  { #ns, ns::dot<double, double>, ns::dot<float, double>,                \
+    ns::dot<float, float>, ns::sub_scaled<double>, ns::sub_scaled<float>, \
+    ns::group_step, ns::group_delta }
+
+  static const KernelTable kTables[] = {
+#ifdef SAM_HAVE_AVX512
+    SAM_KERNEL_TABLE(avx512),
+#endif
+#ifdef SAM_HAVE_AVX2
+    SAM_KERNEL_TABLE(avx2),
+#endif
+    SAM_KERNEL_TABLE(scalar),
+    SAM_KERNEL_TABLE(reproducible)
+  };
+  static const int kNumTables = sizeof(kTables) / sizeof(kTables[0]);
+
+  static bool cpu_supports(const KernelTable& t) {
+    string name = t.name;
+    if (name == "scalar" || name == "reproducible")
+      return true;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (name == "avx2")
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    // Only compiled in when the build itself targets it.
+    return true;
+#endif
+  }
+
+  // Tables are ordered fastest first; scalar always qualifies, so "auto"
+  // never lands on the reproducible one.
+  static const KernelTable* best_table() {
+    for (int t = 0; t < kNumTables; t++)
+      if (cpu_supports(kTables[t]))
+        return &kTables[t];
+    return &kTables[kNumTables - 1];
+  }
+
+  // Fits running on other threads (the bindings release the GIL) may read
+  // the table while it is switched; any table gives the same answers up to
+  // rounding, so relaxed loads are enough.
+  static std::atomic<const KernelTable*> active(best_table());
+
+  static const KernelTable* table() {
+    return active.load(std::memory_order_relaxed);
+  }
+
+  string select_kernels(const string& variant) {
+    if (variant == "auto") {
+      active = best_table();
+      return table()->name;
+    }
+    for (int t = 0; t < kNumTables; t++)
+      if (variant == kTables[t].name) {
+        if (!cpu_supports(kTables[t]))
+          throw std::invalid_argument("this CPU does not support the " + variant + " kernels");
+        active = &kTables[t];
+        return table()->name;
+      }
+    throw std::invalid_argument("unknown kernel variant " + variant);
+  }
+
+  string kernel_variant() {
+    return table()->name;
+  }
+
+  vector<string> kernel_variants() {
+    vector<string> names;
+    for (int t = 0; t < kNumTables; t++)
+      if (cpu_supports(kTables[t]))
+        names.push_back(kTables[t].name);
+    return names;
+  }
+
+
+  double sumsq(const double* x, int n) {
+    return table()->dot_dd(x, x, n);
+  }
+
+  double dot(const double* a, const double* b, int n) {
+    return table()->dot_dd(a, b, n);
+  }
+
+  double dot(const float* a, const double* b, int n) {
+    return table()->dot_fd(a, b, n);
+  }
+
+  double dot(const float* a, const float* b, int n) {
+    return table()->dot_ff(a, b, n);
+  }
+
+  void sub_scaled(double alpha, const double* x, double* y, int n) {
+    table()->sub_scaled_d(alpha, x, y, n);
+  }
+
+  void sub_scaled(double alpha, const float* x, double* y, int n) {
+    table()->sub_scaled_f(alpha, x, y, n);
+  }
+
+  double group_step(const double* w, const double* g, double c, int p, double* z) {
+    return table()->group_step(w, g, c, p, z);
+  }
+
+  double group_delta(const double* z, const double* w, double scale, int p, double* delta) {
+    return table()->group_delta(z, w, scale, p, delta);
+  }
+}
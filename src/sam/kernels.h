@@ -0,0 +1,53 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+namespace SAM {
+  // Vectorized inner loops of the block updates. The column-length
+  // reductions (sumsq and dot) keep several independent accumulators;
+  // sub_scaled has no reduction, and group_step and group_delta, which run
+  // over one short group, use a single vector accumulator. All finish with
+  // a scalar tail, and float inputs are widened to double before they are
+  // multiplied, so the float and double designs share one accumulation
+  // precision.
+  //
+  // AVX-512, AVX2 and scalar variants are all built into one binary; the
+  // fastest one the CPU supports is selected at load time. Their rounding
+  // differs, so the same fit can differ in the last bits between machines.
+  // The "reproducible" variant is never picked automatically: it trades
+  // speed for one fixed summation order without fused multiply-adds, which
+  // makes results bit-identical on any CPU. The solvers' parallel stages
+  // split work into fixed chunks, so results never depend on the thread
+  // count either.
+
+  // "auto", "avx512", "avx2", "scalar" or "reproducible"; returns the
+  // variant now in use.
+  // Throws std::invalid_argument for unknown or unsupported variants. A fit
+  // running concurrently may mix variants, which changes only rounding.
+  extern string select_kernels(const string& variant);
+  extern string kernel_variant();
+  // Variants this CPU can run, fastest first, then "reproducible".
+  extern vector<string> kernel_variants();
+
+  // sum_i x[i]^2
+  extern double sumsq(const double* x, int n);
+  // sum_i a[i] * b[i]
+  extern double dot(const double* a, const double* b, int n);
+  extern double dot(const float* a, const double* b, int n);
+  extern double dot(const float* a, const float* b, int n);
+  // y[i] -= alpha * x[i]
+  extern void sub_scaled(double alpha, const double* x, double* y, int n);
+  extern void sub_scaled(double alpha, const float* x, double* y, int n);
+
+  // Fused pieces of a group update, p = group size:
+  // z = w + c * g, returns ||z||.
+  extern double group_step(const double* w, const double* g, double c, int p, double* z);
+  // delta = scale * z - w, returns ||delta||^2.
+  extern double group_delta(const double* z, const double* w, double scale, int p, double* delta);
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include "ortho.h"
+#include <algorithm>
+#include "utils.h"
+#include "basis.h"
+#include "design.h"
+#include "banded.h"
+#include "binned.h"
+
+using Eigen::Map;
+using Eigen::MatrixXd;
+
+namespace SAM {
+  // Eigenvalues below this fraction of the largest one count as null
+  // directions of a group.
+  static const double kRankTol = 1e-10;
+
+  // p doubles of scratch, on the stack for the usual small groups so the
+  // kernels below do not allocate per block update.
+  class GroupScratch {
+  public:
+    explicit GroupScratch(int p) : heap(p > kStack ? p : 0), ptr(p > kStack ? heap.data() : buf) {}
+    double* data() { return ptr; }
+
+  private:
+    static const int kStack = 32;
+    double buf[kStack];
+    vector<double> heap;
+    double* ptr;
+  };
+
+  template <class Design>
+  void GroupTransform::fit(const Design& X, bool center, bool orthonormalize) {
+    n = X.n, d = X.d, p = X.p, centered = center;
+    mean.assign((size_t)d * p, 0.0);
+    T.assign((size_t)d * p * p, 0.0);
+    rank.assign(d, 0);
+
+    vector<double> ones(center ? n : 0, 1.0);
+    GroupTransform& tf = *this;
+    parallel_features(d, [&](int j) {
+      Map<VectorXd> mu(&tf.mean[(size_t)j * p], p);
+      if (center) {
+        X.xtr(j, ones.data(), mu.data());
+        mu /= n;
+      }
+      Map<MatrixXd> Tj(&tf.T[(size_t)j * p * p], p, p);
+      if (!orthonormalize) {
+        Tj.setIdentity();
+        tf.rank[j] = p;
+        return;
+      }
+
+      MatrixXd G(p, p);
+      X.gram(j, G.data());
+      G /= n;
+      G -= mu * mu.transpose();
+      Eigen::LLT<MatrixXd> llt(G);
+      double dmax = G.diagonal().maxCoeff();
+      bool full_rank = llt.info() == Eigen::Success && dmax > 0;
+      if (full_rank) {
+        VectorXd diag = MatrixXd(llt.matrixL()).diagonal();
+        full_rank = diag.minCoeff() * diag.minCoeff() > kRankTol * dmax;
+      }
+      if (full_rank) {
+        // G = L L^T = R^T R with R = L^T, so T = R^{-1}.
+        Tj = llt.matrixU().solve(MatrixXd::Identity(p, p));
+        tf.rank[j] = p;
+      } else {
+        Eigen::SelfAdjointEigenSolver<MatrixXd> es(G);
+        double top = std::max(es.eigenvalues().maxCoeff(), 0.0);
+        Tj.setZero();
+        int r = 0;
+        for (int k = 0; k < p; k++) {
+          double ev = es.eigenvalues()(k);
+          if (top > 0 && ev > kRankTol * top) {
+            Tj.col(k) = es.eigenvectors().col(k) / sqrt(ev);
+            r++;
+          }
+        }
+        tf.rank[j] = r;
+      }
+    });
+  }
+
+  void GroupTransform::to_original(const double* wt, double* w) const {
+    for (int j = 0; j < d; j++) {
+      Map<const MatrixXd> Tj(&T[(size_t)j * p * p], p, p);
+      Map<const VectorXd> in(wt + (size_t)j * p, p);
+      Map<VectorXd>(w + (size_t)j * p, p) = Tj * in;
+    }
+  }
+
+  void GroupTransform::to_transformed(const double* w, double* wt) const {
+    for (int j = 0; j < d; j++) {
+      Map<const MatrixXd> Tj(&T[(size_t)j * p * p], p, p);
+      Map<const VectorXd> in(w + (size_t)j * p, p);
+      Map<VectorXd>(wt + (size_t)j * p, p) = Tj.completeOrthogonalDecomposition().solve(in);
+    }
+  }
+
+  template <class Design>
+  void OrthoDesign<Design>::xtr(int j, const double* r, double* out) const {
+    GroupScratch scratch(p);
+    Map<VectorXd> g(scratch.data(), p);
+    X.xtr(j, r, g.data());
+    if (tf.centered) {
+      double sum = 0;
+      for (int i = 0; i < n; i++)
+        sum += r[i];
+      g -= sum * Map<const VectorXd>(&tf.mean[(size_t)j * p], p);
+    }
+    Map<const MatrixXd> Tj(&tf.T[(size_t)j * p * p], p, p);
+    Map<VectorXd>(out, p).noalias() = Tj.transpose() * g;
+  }
+
+  template <class Design>
+  void OrthoDesign<Design>::axpy(int j, const double* delta, double* r) const {
+    Map<const MatrixXd> Tj(&tf.T[(size_t)j * p * p], p, p);
+    GroupScratch scratch(p);
+    Map<VectorXd> v(scratch.data(), p);
+    v.noalias() = Tj * Map<const VectorXd>(delta, p);
+    X.axpy(j, v.data(), r);
+    if (tf.centered) {
+      double shift = Map<const VectorXd>(&tf.mean[(size_t)j * p], p).dot(v);
+      for (int i = 0; i < n; i++)
+        r[i] += shift;
+    }
+  }
+
+  template <class Design>
+  void OrthoDesign<Design>::gram(int j, double* out) const {
+    MatrixXd G(p, p);
+    X.gram(j, G.data());
+    if (tf.centered) {
+      Map<const VectorXd> mu(&tf.mean[(size_t)j * p], p);
+      G -= n * mu * mu.transpose();
+    }
+    Map<const MatrixXd> Tj(&tf.T[(size_t)j * p * p], p, p);
+    Map<MatrixXd>(out, p, p) = Tj.transpose() * G * Tj;
+  }
+
+  template void GroupTransform::fit<DenseDesign>(const DenseDesign&, bool, bool);
+  template void GroupTransform::fit<DenseDesignF>(const DenseDesignF&, bool, bool);
+  template void GroupTransform::fit<BandedDesign>(const BandedDesign&, bool, bool);
+  template void GroupTransform::fit<BandedDesignF>(const BandedDesignF&, bool, bool);
+  template void GroupTransform::fit<BinnedDesign>(const BinnedDesign&, bool, bool);
+  template void GroupTransform::fit<RowSubsetDesign>(const RowSubsetDesign&, bool, bool);
+  template void GroupTransform::fit<RowSubsetDesignF>(const RowSubsetDesignF&, bool, bool);
+  template class OrthoDesign<DenseDesign>;
+  template class OrthoDesign<DenseDesignF>;
+  template class OrthoDesign<BandedDesign>;
+  template class OrthoDesign<BandedDesignF>;
+  template class OrthoDesign<BinnedDesign>;
+  template class OrthoDesign<RowSubsetDesign>;
+  template class OrthoDesign<RowSubsetDesignF>;
+}
@@ -0,0 +1,54 @@
+#ifndef ORTHO_H
+#define ORTHO_H
+
+#include <vector>
+using std::vector;
+
+namespace SAM {
+  // Per-group centering and orthonormalization, computed once per design and
+  // reusable across the lambda path and CV folds. With mean_j the column
+  // means of group j and T_j (p x p) the transform,
+  //   Xt_j = (X_j - 1 mean_j^T) T_j   satisfies   Xt_j^T Xt_j / n = I
+  // on the column space of the group. T_j comes from a Cholesky factor of
+  // the centered Gram (T_j = R_j^{-1}); rank deficient groups, such as
+  // centered B-splines summing to one, fall back to an eigendecomposition
+  // and lose their null directions. Coefficients map back as w_j = T_j wt_j.
+  class GroupTransform {
+  public:
+    GroupTransform() : n(0), d(0), p(0), centered(false) {}
+
+    // Fits the transform of every group, in parallel across groups. With
+    // orthonormalize = false only the centering is fitted and T_j = I.
+    template <class Design>
+    void fit(const Design& X, bool center, bool orthonormalize = true);
+
+    // w = T wt for all d groups.
+    void to_original(const double* wt, double* w) const;
+    // The least-squares inverse, wt = T^+ w; exact for w = T wt.
+    void to_transformed(const double* w, double* wt) const;
+
+    int n, d, p;
+    bool centered;
+    vector<double> mean;  // mean[j*p + k]
+    vector<double> T;     // T[j*p*p + ...], column-major p x p
+    vector<int> rank;     // rank[j]
+  };
+
+  // A design seen through a GroupTransform; exposes the same group kernels
+  // as the design it wraps.
+  template <class Design>
+  class OrthoDesign {
+  public:
+    OrthoDesign(const Design& X, const GroupTransform& tf) : X(X), tf(tf), n(X.n), d(X.d), p(X.p) {}
+
+    void xtr(int j, const double* r, double* out) const;
+    void axpy(int j, const double* delta, double* r) const;
+    void gram(int j, double* out) const;
+
+    const Design& X;
+    const GroupTransform& tf;
+    int n, d, p;
+  };
+}
+
+#endif
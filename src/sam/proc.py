@@ -1,3 +1,58 @@
-from . import __grplasso
-def grplasso(y, X, lbd, max_ite, thol, regfunc, inp):
-    return __grplasso(y, X, lbd, max_ite, thol, regfunc, inp)
+from . import __grplasso, __grplasso_array, __bspline_knots, __bspline_basis, __bspline_banded, __bspline_binned, __grplasso_path, __group_transform, __aligned_design, __cv_grplasso, __cv_grplasso_halving, SolverOptions
+def grplasso(y, X, lbd, max_ite, thol, regfunc, inp, p=0, workspace=None):
+    # NumPy input skips the list marshalling and, when X is already in the
+    # solver's layout (Fortran-ordered (n, d*p)), the copy as well.
+    if hasattr(X, '__array_interface__'):
+        return __grplasso_array(y, X, lbd, max_ite, thol, regfunc, inp, p, workspace)
+    return __grplasso(y, X, lbd, max_ite, thol, regfunc, inp, workspace)
+
+def grplasso_path(y, X, lbd, max_ite=1000, thol=1e-4, regfunc='L1', inp=1, p=0, workspace=None, transform=None, **options):
+    # Native path solver. X is a dense array, BandedDesign or BinnedDesign;
+    # extra keyword arguments set the matching SolverOptions fields.
+    opt = SolverOptions()
+    opt.max_ite, opt.thol, opt.regfunc, opt.lambda_input = max_ite, thol, regfunc, inp
+    for key, value in options.items():
+        if not hasattr(opt, key):
+            raise TypeError('unknown solver option ' + key)
+        setattr(opt, key, value)
+    if hasattr(X, '__array_interface__'):
+        return __grplasso_path(y, X, lbd, p, opt, workspace, transform)
+    return __grplasso_path(y, X, lbd, opt, workspace, transform)
+
+def cv_grplasso(y, X, folds, lbd, max_ite=1000, thol=1e-4, regfunc='L1', inp=1, p=0, halving=False, initial_folds=2, z=2.0, **options):
+    # Native K-fold CV on a dense X; folds[i] is the held-out fold of row i.
+    # `halving` prunes clearly worse lambdas after the first folds.
+    opt = SolverOptions()
+    opt.max_ite, opt.thol, opt.regfunc, opt.lambda_input = max_ite, thol, regfunc, inp
+    for key, value in options.items():
+        if not hasattr(opt, key):
+            raise TypeError('unknown solver option ' + key)
+        setattr(opt, key, value)
+    if halving:
+        return __cv_grplasso_halving(y, X, folds, lbd, p, opt, initial_folds, z)
+    return __cv_grplasso(y, X, folds, lbd, p, opt)
+
+def group_transform(X, p=0, center=True):
+    # Replaces standardizing X in Python: pass the result as `transform`.
+    if hasattr(X, '__array_interface__'):
+        return __group_transform(X, p, center)
+    return __group_transform(X, center)
+
+def aligned_design(n, d, p, single=False):
+    # Preallocated (n, d*p) design with padded, cache-aligned columns; fill
+    # it in place and grplasso_path(..., p=p) uses it without a copy.
+    return __aligned_design(n, d, p, single)
+
+def bspline_knots(X, p, degree=3):
+    return __bspline_knots(X, p, degree)
+
+def bspline_basis(X, knots, degree=3, single=False):
+    # Returns the Fortran-ordered (n, d*p) design, ready for grplasso(..., p=p).
+    # `single` stores it as float32; the solver still accumulates in double.
+    return __bspline_basis(X, knots, degree, single)
+
+def bspline_banded(X, knots, degree=3, single=False):
+    return __bspline_banded(X, knots, degree, single)
+
+def bspline_binned(X, knots, degree=3, max_bins=256):
+    return __bspline_binned(X, knots, degree, max_bins)
@@ -0,0 +1,1025 @@
+#include "solver.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "utils.h"
+#include "kernels.h"
+#include "design.h"
+#include "banded.h"
+#include "binned.h"
+#include "ortho.h"
+#include "gram.h"
+#include "thread_pool.h"
+
+namespace SAM {
+  Penalty parse_penalty(const string& regfunc) {
+    if (regfunc == "L1")
+      return L1;
+    if (regfunc == "MCP")
+      return MCP;
+    if (regfunc == "SCAD")
+      return SCAD;
+    throw std::invalid_argument("regfunc must be one of L1, MCP, SCAD");
+  }
+
+  Screening parse_screening(const string& screening) {
+    if (screening == "none")
+      return SCREEN_NONE;
+    if (screening == "strong")
+      return SCREEN_STRONG;
+    if (screening == "gap_safe")
+      return SCREEN_GAP_SAFE;
+    throw std::invalid_argument("screening must be one of none, strong, gap_safe");
+  }
+
+  Criteria parse_criteria(const string& criteria) {
+    if (criteria == "off")
+      return CRITERIA_OFF;
+    if (criteria == "exact")
+      return CRITERIA_EXACT;
+    if (criteria == "hutchinson")
+      return CRITERIA_HUTCHINSON;
+    if (criteria == "auto")
+      return CRITERIA_AUTO;
+    throw std::invalid_argument("criteria must be one of off, auto, exact, hutchinson");
+  }
+
+  double threshold(Penalty pen, double z, double lambda, double gamma, double L) {
+    switch (pen) {
+    case MCP:
+      return MCPPenalty(gamma).threshold(z, lambda, L);
+    case SCAD:
+      return SCADPenalty(gamma).threshold(z, lambda, L);
+    default:
+      return L1Penalty().threshold(z, lambda, L);
+    }
+  }
+
+  // Relative duality-gap target of the gap-safe mode is checked (and the
+  // safe tests rerun) once per this many sweeps; each check costs a full
+  // pass over the groups.
+  static const int kGapFreq = 10;
+
+  // Round-off guards of the sphere tests. Active groups sit at
+  // ||X_j^T theta|| = 1 only up to round-off, and a converged gap can round
+  // to 0, so the radius uses gap + kGapRoundoff * ||y||^2 / (2n) and the
+  // test keeps kSafeMargin of slack below 1.
+  static const double kGapRoundoff = 1e-13;
+  static const double kSafeMargin = 1e-9;
+
+  // Size of the first working set when the warm start has few nonzero groups.
+  static const int kWorkingSetMin = 10;
+
+  // Full gradient passes go to the thread pool once they touch this many
+  // design entries, kPassChunk groups per task.
+  static const double kParallelWork = 1 << 16;
+  static const int kPassChunk = 16;
+
+  // Parallel block CD starts with batches of this many groups and merges
+  // residual changes in blocks of kRowBlock rows. Neither depends on the
+  // thread count, so the result does not either.
+  static const int kBatchGroups = 512;
+  static const int kRowBlock = 4096;
+
+  // Effective df: exact traces up to this many active coefficients, else
+  // kTraceProbes Hutchinson probes with CG solved to kTraceTol.
+  static const int kExactTrace = 500;
+  static const int kTraceProbes = 32;
+  static const double kTraceTol = 1e-8;
+
+  // Scratch for one group: a plain array when the group size P is a
+  // compile-time constant, a vector otherwise.
+  template <int P>
+  struct GroupBuf {
+    explicit GroupBuf(int) {}
+    double* data() { return v; }
+    double& operator[](int k) { return v[k]; }
+    double v[P];
+  };
+
+  template <>
+  struct GroupBuf<0> {
+    explicit GroupBuf(int p) : v(p) {}
+    double* data() { return v.data(); }
+    double& operator[](int k) { return v[k]; }
+    vector<double> v;
+  };
+
+  // Shared state of one path fit; the design specific parts are the kernels.
+  // In covariance mode the residual is never formed: the solver keeps
+  // c = X^T r current through cached cross-Gram blocks instead, and every
+  // quantity that needs r is derived from c, X^T y and ||y||^2.
+  //
+  // P > 0 fixes the group size at compile time, so the per-group loops of
+  // the block update are fully unrolled instead of going through the
+  // length-generic kernels; P = 0 takes p from the design. Policy is one of
+  // the penalty policies in solver.h.
+  template <class Design, int P, class Policy>
+  struct BlockSolver {
+    const Design& X;
+    const double* y;
+    int n, d, p;
+    Policy penalty;
+    double* r;           // residual y - X w (unused in covariance mode)
+    double* w;           // current coefficients, w[j*p + k]
+    vector<double> eig;  // largest eigenvalue of X_j^T X_j / n
+    vector<double> L;    // per group curvature bound
+    vector<double> gnorm;  // ||X_j^T r|| / n as of the last full pass
+    GroupBuf<P> g, z, delta;
+    GramCache<Design>* cov;
+    vector<double> c, xty;  // X^T r and X^T y (covariance mode)
+    double yty;
+    // Parallel block CD: groups per batch (1 = serial updates), the batch's
+    // moves [a*p + k] and their squared norms, and one residual delta per
+    // chunk of kPassChunk groups, sized once for the largest batch and kept
+    // zero between batches; btouched marks the chunks that moved.
+    int batch;
+    vector<double> bdelta, bstep, bresid;
+    vector<char> btouched;
+
+    BlockSolver(const Design& X, const double* y, const Policy& penalty, GrpLassoWorkspace& ws, GramCache<Design>* cov, bool parallel)
+      : X(X), y(y), n(X.n), d(X.d), p(X.p), penalty(penalty),
+        r(ws.residual()), w(ws.coef()), eig(X.d), L(X.d), gnorm(X.d),
+        g(X.p), z(X.p), delta(X.p), cov(cov), yty(0),
+        batch(parallel && !cov ? kBatchGroups : 1) {
+      // L_j = largest eigenvalue of X_j^T X_j / n makes the quadratic
+      // majorizer of each block valid. The non-convex penalties need
+      // L_j > 1/gamma (MCP) or 1/(gamma-1) (SCAD), and a larger L is still a
+      // majorizer, so raise it when necessary.
+      double floor = penalty.curvature_floor();
+      Eigen::MatrixXd G(p, p);
+      for (int j = 0; j < d; j++) {
+        X.gram(j, G.data());
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(G / n, Eigen::EigenvaluesOnly);
+        eig[j] = L[j] = es.eigenvalues().maxCoeff();
+        if (L[j] > 0 && Policy::kind != L1)
+          L[j] = std::max(L[j], floor * 1.01);
+      }
+      if (batch > 1) {
+        int nchunks = (std::min(batch, d) + kPassChunk - 1) / kPassChunk;
+        bresid.assign((size_t)nchunks * n, 0.0);
+        btouched.resize(nchunks);
+      }
+      std::copy(y, y + n, r);
+      std::fill(w, w + (size_t)d * p, 0.0);
+      yty = sumsq(y, n);
+      if (cov) {
+        c.resize((size_t)d * p);
+        for (int j = 0; j < d; j++)
+          X.xtr(j, y, &c[(size_t)j * p]);
+        xty = c;
+      }
+    }
+
+    // Restarts from coefficients w0: rebuilds r (or X^T r) and the
+    // gradient norms for them.
+    void start_from(const double* w0) {
+      std::copy(w0, w0 + (size_t)d * p, w);
+      if (cov)
+        std::copy(xty.begin(), xty.end(), c.begin());
+      else
+        std::copy(y, y + n, r);
+      for (int j = 0; j < d; j++)
+        if (nonzero(j))
+          apply(j, w + (size_t)j * p);
+      full_pass();
+    }
+
+    // out = X_j^T r.
+    void gradient(int j, double* out) const {
+      if (cov)
+        std::copy(&c[(size_t)j * p], &c[(size_t)(j + 1) * p], out);
+      else
+        X.xtr(j, r, out);
+    }
+
+    void gradient(int j) {
+      gradient(j, g.data());
+    }
+
+    // r -= X_j delta (or the matching update of X^T r).
+    void apply(int j, const double* dl) {
+      if (cov)
+        cov->downdate(j, dl, c.data());
+      else
+        X.axpy(j, dl, r);
+    }
+
+    double dot_w(const double* v) const {
+      return dot(v, w, d * p);
+    }
+
+    // y^T r and ||r||^2; with r = y - X w, ||r||^2 = y^T r - w^T X^T r.
+    double y_dot_r() const {
+      if (cov)
+        return yty - dot_w(xty.data());
+      return dot(y, r, n);
+    }
+
+    double rss() const {
+      if (cov)
+        return y_dot_r() - dot_w(c.data());
+      return sumsq(r, n);
+    }
+
+    // ||X_j w_j|| / sqrt(n).
+    double func_norm(int j, vector<double>& fit) {
+      const double* wj = w + (size_t)j * p;
+      if (cov) {
+        const double* col = cov->column(j) + (size_t)j * p;
+        size_t m = (size_t)d * p;
+        double acc = 0;
+        for (int l = 0; l < group_size(); l++)
+          for (int k = 0; k < group_size(); k++)
+            acc += wj[k] * col[l * m + k] * wj[l];
+        return sqrt(std::max(acc, 0.0) / n);
+      }
+      std::fill(fit.begin(), fit.end(), 0.0);
+      X.axpy(j, wj, fit.data());
+      return calc_norm(fit.data(), n) / sqrt((double)n);
+    }
+
+    // Group size as a compile-time constant when there is one.
+    int group_size() const {
+      return P > 0 ? P : p;
+    }
+
+    // ||X_j^T r|| / n, using buf (p doubles) as scratch.
+    double grad_norm(int j, double* buf) const {
+      gradient(j, buf);
+      if (P > 0) {
+        double acc = 0;
+        for (int k = 0; k < P; k++)
+          acc += buf[k] * buf[k];
+        return sqrt(acc) / n;
+      }
+      return calc_norm(buf, p) / n;
+    }
+
+    // Refreshes gnorm for every group (lambda_max, KKT checks, gap
+    // evaluations). Groups are independent here, so large passes are
+    // split over the thread pool.
+    void full_pass() {
+      if ((double)n * d * p < kParallelWork) {
+        for (int j = 0; j < d; j++)
+          gnorm[j] = grad_norm(j, g.data());
+        return;
+      }
+      int nchunks = (d + kPassChunk - 1) / kPassChunk;
+      parallel_for(nchunks, [this](int chunk) {
+        GroupBuf<P> buf(p);
+        int end = std::min(d, (chunk + 1) * kPassChunk);
+        for (int j = chunk * kPassChunk; j < end; j++)
+          gnorm[j] = grad_norm(j, buf.data());
+      });
+    }
+
+    bool nonzero(int j) const {
+      const double* wj = w + (size_t)j * p;
+      for (int k = 0; k < group_size(); k++)
+        if (wj[k] != 0)
+          return true;
+      return false;
+    }
+
+    // The majorized block update of group j at the current r, without
+    // applying it: fills dl with delta_j and returns ||delta_j||^2 (0 means
+    // no move, dl is then unspecified). gj and zj are p doubles of scratch.
+    double propose(int j, double lambda, double* gj, double* zj, double* dl) const {
+      if (L[j] <= 0)
+        return 0;
+      const double* wj = w + (size_t)j * p;
+      gradient(j, gj);
+      double c = 1 / (n * L[j]), zn;
+      if (P > 0) {
+        double acc = 0;
+        for (int k = 0; k < P; k++) {
+          zj[k] = wj[k] + c * gj[k];
+          acc += zj[k] * zj[k];
+        }
+        zn = sqrt(acc);
+      } else {
+        zn = group_step(wj, gj, c, p, zj);
+      }
+      double t = penalty.threshold(zn, lambda, L[j]);
+      double scale = zn > 0 ? t / zn : 0;
+      if (P > 0) {
+        double step = 0;
+        for (int k = 0; k < P; k++) {
+          dl[k] = scale * zj[k] - wj[k];
+          step += dl[k] * dl[k];
+        }
+        return step;
+      }
+      return group_delta(zj, wj, scale, p, dl);
+    }
+
+    // One majorized block update of group j; returns ||delta_j||.
+    double update(int j, double lambda) {
+      double step = propose(j, lambda, g.data(), z.data(), delta.data());
+      if (step == 0)
+        return 0;
+      apply(j, delta.data());
+      double* wj = w + (size_t)j * p;
+      for (int k = 0; k < group_size(); k++)
+        wj[k] += delta[k];
+      return sqrt(step);
+    }
+
+    // Updates the m groups js[0..m) concurrently from the same residual;
+    // returns the largest ||delta_j||. Each group's move minimizes its own
+    // majorizer, so the batch descends whenever
+    // ||sum_j X_j delta_j||^2 / n <= sum_j L_j ||delta_j||^2. When that fails
+    // the groups conflict: the batch is redone serially and batches shrink;
+    // every batch that passes lets them grow back.
+    double update_batch(const int* js, int m, double lambda) {
+      int nchunks = (m + kPassChunk - 1) / kPassChunk;
+      bdelta.resize((size_t)m * p);
+      bstep.resize(m);
+      parallel_for(nchunks, [&](int chunk) {
+        GroupBuf<P> gj(p), zj(p);
+        double* u = &bresid[(size_t)chunk * n];
+        int end = std::min(m, (chunk + 1) * kPassChunk);
+        bool touched = false;
+        for (int a = chunk * kPassChunk; a < end; a++) {
+          double* dl = &bdelta[(size_t)a * p];
+          bstep[a] = propose(js[a], lambda, gj.data(), zj.data(), dl);
+          if (bstep[a] > 0) {
+            X.axpy(js[a], dl, u);
+            touched = true;
+          }
+        }
+        btouched[chunk] = touched;
+      });
+      vector<int> used;
+      for (int chunk = 0; chunk < nchunks; chunk++)
+        if (btouched[chunk])
+          used.push_back(chunk);
+      if (used.empty())
+        return 0;
+
+      // Sum the moved chunks, always in chunk order, into the first one,
+      // clearing the others as they are read.
+      double* sum = &bresid[(size_t)used[0] * n];
+      int nblocks = (n + kRowBlock - 1) / kRowBlock;
+      vector<double> part(nblocks);
+      parallel_for(nblocks, [&](int b) {
+        int end = std::min(n, (b + 1) * kRowBlock);
+        double acc = 0;
+        for (int i = b * kRowBlock; i < end; i++) {
+          double v = sum[i];
+          for (size_t c = 1; c < used.size(); c++) {
+            double* u = &bresid[(size_t)used[c] * n];
+            v += u[i];
+            u[i] = 0;
+          }
+          sum[i] = v;
+          acc += v * v;
+        }
+        part[b] = acc;
+      });
+      double moved = 0, bound = 0;
+      for (int b = 0; b < nblocks; b++)
+        moved += part[b];
+      for (int a = 0; a < m; a++)
+        bound += L[js[a]] * bstep[a];
+
+      double change = 0;
+      if (moved / n > bound * (1 + 1e-10)) {
+        std::fill(sum, sum + n, 0.0);
+        batch = std::max(1, batch / 2);
+        for (int a = 0; a < m; a++)
+          change = std::max(change, update(js[a], lambda));
+        return change;
+      }
+      // sum holds -sum_j X_j delta_j.
+      for (int i = 0; i < n; i++) {
+        r[i] += sum[i];
+        sum[i] = 0;
+      }
+      for (int a = 0; a < m; a++) {
+        if (bstep[a] == 0)
+          continue;
+        double* wj = w + (size_t)js[a] * p;
+        for (int k = 0; k < group_size(); k++)
+          wj[k] += bdelta[(size_t)a * p + k];
+        change = std::max(change, sqrt(bstep[a]));
+      }
+      batch = std::min(kBatchGroups, 2 * batch);
+      return change;
+    }
+
+    // Every lambda starts from full batches again, so conflicts early in
+    // the path do not leave the rest of it serial.
+    void reset_batch() {
+      if (!btouched.empty())
+        batch = kBatchGroups;
+    }
+
+    // One pass of block updates over set; returns the largest ||delta_j||.
+    double sweep(const vector<int>& set, double lambda) {
+      double change = 0;
+      size_t s = 0;
+      while (s < set.size()) {
+        int m = std::min<size_t>(batch, set.size() - s);
+        if (m > 1) {
+          change = std::max(change, update_batch(&set[s], m, lambda));
+        } else {
+          change = std::max(change, update(set[s], lambda));
+        }
+        s += m;
+      }
+      return change;
+    }
+
+    // Sets group j to zero, keeping r in sync.
+    void zero(int j) {
+      double* wj = w + (size_t)j * p;
+      for (int k = 0; k < group_size(); k++)
+        delta[k] = -wj[k];
+      apply(j, delta.data());
+      std::fill(wj, wj + group_size(), 0.0);
+    }
+
+    // Duality gap of the L1 problem at the current w, from the gradient
+    // norms of the last full pass. The dual point is theta = r / (n s) with
+    // s = max(lambda, max_j gnorm[j]), which makes every ||X_j^T theta|| <= 1;
+    // the dual objective is ||y||^2/(2n) - n lambda^2/2 ||theta - y/(n lambda)||^2.
+    double duality_gap(double lambda, double& s) const {
+      s = lambda;
+      double pen_sum = 0;
+      for (int j = 0; j < d; j++) {
+        s = std::max(s, gnorm[j]);
+        pen_sum += calc_norm(w + (size_t)j * p, p);
+      }
+      // theta - y/(n lambda) = a y - X w / (n s) with a = 1/(n s) - 1/(n lambda).
+      // Expanding ||r||^2 instead would cancel catastrophically when s is
+      // close to lambda, so covariance mode uses this form.
+      double ns = n * s, a = 1 / ns - 1 / (n * lambda), dist = 0;
+      if (cov) {
+        double ytxw = dot_w(xty.data()), xw2 = ytxw - dot_w(c.data());
+        dist = a * a * yty - 2 * a / ns * ytxw + xw2 / (ns * ns);
+      } else {
+        for (int i = 0; i < n; i++) {
+          double diff = r[i] / ns - y[i] / (n * lambda);
+          dist += diff * diff;
+        }
+      }
+      double primal = rss() / (2 * n) + lambda * pen_sum;
+      double dual = yty / (2 * n) - n * lambda * lambda / 2 * std::max(dist, 0.0);
+      return std::max(primal - dual, 0.0);
+    }
+
+    // Smoother of the active groups A at the current w. The solution is a
+    // stationary point of the smooth objective restricted to A, with Hessian
+    //   M = X_A^T X_A / n + blockdiag_j(pen''(t) u u^T + pen'(t) / t (I - u u^T)),
+    // t = ||w_j||, u = w_j / t, and the fit moves with y through
+    // H = X_A M^{-1} X_A^T / n. ALO and the effective df are both read off H.
+    // Block CD keeps no factorization to reuse, so M is built here.
+    vector<int> active() const {
+      vector<int> act;
+      for (int j = 0; j < d; j++)
+        if (nonzero(j))
+          act.push_back(j);
+      return act;
+    }
+
+    // out += (penalty Hessian of active group a) v, for q-vectors.
+    void penalty_hessian(const vector<int>& act, double lambda, const double* v, double* out) const {
+      for (size_t a = 0; a < act.size(); a++) {
+        const double* wj = w + (size_t)act[a] * p;
+        double t = calc_norm(wj, p), uv = 0;
+        for (int k = 0; k < p; k++)
+          uv += wj[k] / t * v[a * p + k];
+        double slope = penalty.derivative(t, lambda) / t;
+        double bend = penalty.second_derivative(t, lambda);
+        for (int k = 0; k < p; k++)
+          out[a * p + k] += slope * v[a * p + k] + (bend - slope) * uv * wj[k] / t;
+      }
+    }
+
+    // Diagonal of H (the active part, without the intercept). M is built
+    // column by column through the design kernels (its lower triangle, all
+    // the Cholesky reads) and factored once as L L^T; h_i = ||L^{-1} x_i||^2
+    // / n is then the squared row norm of X_A L^{-T}, streamed one column at
+    // a time. O(n q^2 + q^3) time and O(n + q^2) memory for q = |A| p.
+    // Non-convex penalties can make M indefinite, and h is then NaN.
+    Eigen::VectorXd leverages(const vector<int>& act, double lambda) const {
+      int q = act.size() * p;
+      Eigen::VectorXd h = Eigen::VectorXd::Zero(n);
+      if (q == 0)
+        return h;
+      Eigen::MatrixXd M = Eigen::MatrixXd::Zero(q, q), I = Eigen::MatrixXd::Identity(q, q);
+      vector<double> u(n);
+      for (size_t a = 0; a < act.size(); a++)
+        for (int k = 0; k < p; k++) {
+          int c = a * p + k;
+          std::fill(u.begin(), u.end(), 0.0);
+          X.axpy(act[a], I.col(c).data() + a * p, u.data());
+          for (size_t b = a; b < act.size(); b++)
+            X.xtr(act[b], u.data(), M.col(c).data() + b * p);
+        }
+      M /= -n;
+      for (int c = 0; c < q; c++)
+        penalty_hessian(act, lambda, I.col(c).data(), M.col(c).data());
+      Eigen::LLT<Eigen::MatrixXd> llt(M);
+      if (llt.info() != Eigen::Success) {
+        h.fill(std::numeric_limits<double>::quiet_NaN());
+        return h;
+      }
+
+      // Column c of X_A L^{-T} is -u after u = 0, axpy(g_c), g_c = L^{-T} e_c.
+      Eigen::MatrixXd G = llt.matrixU().solve(I);
+      Eigen::Map<Eigen::VectorXd> uv(u.data(), n);
+      for (int c = 0; c < q; c++) {
+        std::fill(u.begin(), u.end(), 0.0);
+        for (size_t a = 0; a < act.size(); a++)
+          X.axpy(act[a], G.col(c).data() + a * p, u.data());
+        h += uv.cwiseAbs2();
+      }
+      return h / n;
+    }
+
+    // Approximate leave-one-out risk of the squared loss (ALO): one Newton
+    // step from the solution without row i gives the LOO residual
+    // r_i / (1 - h_ii), with 1/n added to h for the intercept that
+    // centering removed. A saturated fit (some h_ii + 1/n >= 1) has no
+    // finite estimate and gives inf.
+    double alo_risk(const vector<int>& act, const Eigen::VectorXd& h) const {
+      vector<double> res(r, r + (cov ? 0 : n));
+      if (cov) {
+        res.assign(y, y + n);
+        for (int j : act)
+          X.axpy(j, w + (size_t)j * p, res.data());
+      }
+      double risk = 0;
+      for (int i = 0; i < n; i++) {
+        double keep = 1 - h[i] - 1.0 / n;
+        if (keep <= 0)
+          return std::numeric_limits<double>::infinity();
+        double loo = res[i] / keep;
+        risk += loo * loo / n;
+      }
+      return risk;
+    }
+
+    // Hutchinson estimate of tr(H): the mean of z^T H z over Rademacher
+    // probes z, each needing one conjugate-gradient solve with M applied
+    // through the design kernels, so X_A is never formed. The probes come
+    // from a fixed seed, so the estimate is reproducible.
+    double hutchinson_trace(const vector<int>& act, double lambda) const {
+      int q = act.size() * p;
+      if (q == 0)
+        return 0;
+      vector<double> z(n), tmp(n), b(q), x(q), res(q), dir(q), Md(q);
+      auto apply = [&](const double* v, double* out) {
+        std::fill(tmp.begin(), tmp.end(), 0.0);
+        for (size_t a = 0; a < act.size(); a++)
+          X.axpy(act[a], v + a * p, tmp.data());
+        for (size_t a = 0; a < act.size(); a++)
+          X.xtr(act[a], tmp.data(), out + a * p);
+        for (int c = 0; c < q; c++)
+          out[c] /= -n;
+        penalty_hessian(act, lambda, v, out);
+      };
+      unsigned seed = 20240611;
+      double sum = 0;
+      for (int probe = 0; probe < kTraceProbes; probe++) {
+        for (int i = 0; i < n; i++) {
+          seed = seed * 1103515245 + 12345;
+          z[i] = (seed >> 16) & 1 ? 1 : -1;
+        }
+        for (size_t a = 0; a < act.size(); a++)
+          X.xtr(act[a], z.data(), &b[a * p]);
+        std::fill(x.begin(), x.end(), 0.0);
+        res = b;
+        dir = b;
+        double rr = dot(res.data(), res.data(), q), stop = kTraceTol * kTraceTol * rr;
+        for (int it = 0; it < q && rr > stop; it++) {
+          apply(dir.data(), Md.data());
+          // CG needs M positive definite, which the concave parts of MCP
+          // and SCAD can break; as in leverages() there is no estimate then.
+          double curv = dot(dir.data(), Md.data(), q);
+          if (!(curv > 0))
+            return std::numeric_limits<double>::quiet_NaN();
+          double alpha = rr / curv;
+          for (int c = 0; c < q; c++) {
+            x[c] += alpha * dir[c];
+            res[c] -= alpha * Md[c];
+          }
+          double rr_next = dot(res.data(), res.data(), q);
+          for (int c = 0; c < q; c++)
+            dir[c] = res[c] + rr_next / rr * dir[c];
+          rr = rr_next;
+        }
+        sum += dot(b.data(), x.data(), q) / n;
+      }
+      return sum / kTraceProbes;
+    }
+
+    // Sequential strong rule plus KKT check. Returns the sweeps used.
+    int solve_strong(double lambda, double lambda_prev, bool screen, int max_ite, double thol, int& kept, int& violations) {
+      // Group j is unlikely to enter at lambda when ||X_j^T r(lambda_prev)||
+      // / n < 2 lambda - lambda_prev. Nonzero groups always stay.
+      vector<char> strong(d);
+      for (int j = 0; j < d; j++)
+        strong[j] = !screen || nonzero(j) || gnorm[j] >= 2 * lambda - lambda_prev;
+
+      vector<int> set;
+      int ite = 0;
+      violations = 0;
+      while (true) {
+        set.clear();
+        for (int j = 0; j < d; j++)
+          if (strong[j])
+            set.push_back(j);
+        for (; ite < max_ite; ite++) {
+          double change = sweep(set, lambda);
+          if (change < thol) {
+            ite++;
+            break;
+          }
+        }
+
+        // At w_j = 0 every penalty requires ||X_j^T r|| / n <= lambda.
+        // Discarded groups violating that join the strong set and the
+        // subproblem is solved again.
+        full_pass();
+        int added = 0;
+        for (int j = 0; j < d; j++)
+          if (!strong[j] && gnorm[j] > lambda * (1 + 1e-8)) {
+            strong[j] = 1;
+            added++;
+          }
+        violations += added;
+        if (added == 0 || ite >= max_ite)
+          break;
+      }
+      kept = set.size();
+      return ite;
+    }
+
+    // Gap-safe screening (L1 only). A group whose sphere test
+    // ||X_j^T theta|| + R ||X_j||_2 < 1 passes, R = sqrt(2 n gap) / (n lambda),
+    // is zero at the optimum and is dropped for the rest of this lambda. The
+    // tests rerun with every gap evaluation, and the solve stops once the gap
+    // falls below thol relative to the null objective ||y||^2 / (2n).
+    int solve_gap_safe(double lambda, int max_ite, double thol, int& kept, double& gap) {
+      double null_obj = 0;
+      for (int i = 0; i < n; i++)
+        null_obj += y[i] * y[i] / (2 * n);
+
+      vector<char> alive(d, 1);
+      vector<int> set;
+      int ite = 0;
+      while (true) {
+        full_pass();
+        double s;
+        gap = duality_gap(lambda, s);
+        double R = sqrt(2 * n * (gap + kGapRoundoff * null_obj)) / (n * lambda);
+        // Zeroing a nonzero group changes w, so the gap is stale until the
+        // next check.
+        bool zeroed = false;
+        set.clear();
+        for (int j = 0; j < d; j++) {
+          if (alive[j] && gnorm[j] / s + R * sqrt(n * eig[j]) < 1 - kSafeMargin) {
+            alive[j] = 0;
+            if (nonzero(j)) {
+              zero(j);
+              zeroed = true;
+            }
+          }
+          if (alive[j])
+            set.push_back(j);
+        }
+        if ((gap <= thol * null_obj && !zeroed) || ite >= max_ite)
+          break;
+        for (int f = 0; f < kGapFreq && ite < max_ite; f++, ite++)
+          sweep(set, lambda);
+      }
+      kept = set.size();
+      return ite;
+    }
+
+    // Working-set outer loop (in the style of Blitz / Celer). Solves the
+    // problem restricted to a small set W of prioritized groups, then
+    // rebuilds W from all groups, doubling its size, until the full problem
+    // is solved: for L1 when the duality gap is below thol relative to
+    // ||y||^2 / (2n), otherwise when W has converged and no group outside it
+    // violates its KKT condition. Groups are prioritized by their distance to
+    // the dual constraint (L1) or their KKT violation; nonzero groups always
+    // stay in W. With `safe`, gap-safe tests also remove groups for good.
+    int solve_working_set(double lambda, bool safe, int max_ite, double thol, int& kept, double& gap) {
+      double null_obj = 0;
+      for (int i = 0; i < n; i++)
+        null_obj += y[i] * y[i] / (2 * n);
+
+      vector<char> alive(d, 1);
+      vector<double> score(d);
+      vector<int> set, order;
+      int size = 0;
+      for (int j = 0; j < d; j++)
+        size += nonzero(j);
+      size = std::min(d, std::max(kWorkingSetMin, 2 * size));
+
+      int ite = 0;
+      bool converged = false;
+      while (true) {
+        full_pass();
+        bool done;
+        if (Policy::kind == L1) {
+          double s;
+          gap = duality_gap(lambda, s);
+          double R = sqrt(2 * n * (gap + kGapRoundoff * null_obj)) / (n * lambda);
+          bool zeroed = false;
+          for (int j = 0; j < d; j++) {
+            double norm_j = sqrt(n * eig[j]);
+            if (safe && alive[j] && gnorm[j] / s + R * norm_j < 1 - kSafeMargin) {
+              alive[j] = 0;
+              if (nonzero(j)) {
+                zero(j);
+                zeroed = true;
+              }
+            }
+            if (nonzero(j))
+              score[j] = -1;
+            else
+              score[j] = norm_j > 0 ? (1 - gnorm[j] / s) / norm_j : std::numeric_limits<double>::infinity();
+          }
+          done = gap <= thol * null_obj && !zeroed;
+        } else {
+          double worst = 0;
+          for (int j = 0; j < d; j++) {
+            score[j] = nonzero(j) ? -1 : lambda - gnorm[j];
+            if (!nonzero(j))
+              worst = std::max(worst, gnorm[j] - lambda * (1 + 1e-8));
+          }
+          done = converged && worst <= 0;
+        }
+        if (done || ite >= max_ite)
+          break;
+
+        order.clear();
+        for (int j = 0; j < d; j++)
+          if (alive[j])
+            order.push_back(j);
+        int take = std::min<int>(size, order.size());
+        std::partial_sort(order.begin(), order.begin() + take, order.end(),
+                          [&](int a, int b) { return score[a] < score[b]; });
+        set.assign(order.begin(), order.begin() + take);
+        std::sort(set.begin(), set.end());
+
+        converged = false;
+        for (; ite < max_ite && !converged; ite++)
+          converged = sweep(set, lambda) < thol;
+        size = std::min(d, 2 * size);
+      }
+      kept = set.size();
+      return ite;
+    }
+  };
+
+  // Gaussian criteria at lambda l from sse and edf; the intercept counts as
+  // one more degree of freedom. eBIC adds 2 gamma log C(d, df) for the
+  // choice of df groups out of d. An interpolating fit (sse = 0) has no
+  // finite log-likelihood, so its AIC, BIC and eBIC are NaN.
+  static void information_criteria(PathResult& out, int l, double gamma) {
+    int n = out.n;
+    double k = out.edf[l] + 1;
+    double fit = out.sse[l] > 0 ? n * std::log(out.sse[l] / n) : std::numeric_limits<double>::quiet_NaN();
+    out.gcv[l] = out.sse[l] / n / ((1 - k / n) * (1 - k / n));
+    out.aic[l] = fit + 2 * k;
+    out.bic[l] = fit + std::log((double)n) * k;
+    double log_choose = std::lgamma(out.d + 1.0) - std::lgamma(out.df[l] + 1.0) - std::lgamma(out.d - out.df[l] + 1.0);
+    out.ebic[l] = out.bic[l] + 2 * gamma * log_choose;
+  }
+
+  template <int P, class Policy, class Design>
+  static void solve_path(const Design& X, const double* y, const vector<double>& lambda, const SolverOptions& opt, const Policy& penalty, GrpLassoWorkspace& ws, PathResult& out, const double* warm, const GramDowndate<Design>* gram) {
+    int n = X.n, d = X.d, p = X.p, nlambda = lambda.size();
+    Screening screening = parse_screening(opt.screening);
+    if (screening == SCREEN_GAP_SAFE && Policy::kind != L1)
+      throw std::invalid_argument("gap_safe screening needs the convex L1 penalty");
+
+    bool covariance;
+    if (opt.covariance == "auto")
+      covariance = use_covariance(n, d, p);
+    else if (opt.covariance == "on" || opt.covariance == "off")
+      covariance = opt.covariance == "on";
+    else
+      throw std::invalid_argument("covariance must be one of auto, on, off");
+
+    ws.reserve(n, d, p, false);
+    GramCache<Design> cache(X, gram);
+    BlockSolver<Design, P, Policy> S(X, y, penalty, ws, covariance ? &cache : NULL, opt.parallel_cd);
+
+    // Gradient norms at w = 0; their maximum is the smallest lambda with an
+    // all-zero solution.
+    S.full_pass();
+    double lambda_max = *std::max_element(S.gnorm.begin(), S.gnorm.end());
+
+    out.n = n, out.d = d, out.p = p, out.nlambda = nlambda;
+    out.lambda = lambda;
+    if (!opt.lambda_input)
+      for (int l = 0; l < nlambda; l++)
+        out.lambda[l] *= lambda_max;
+    out.w.assign((size_t)nlambda * d * p, 0.0);
+    out.df.assign(nlambda, 0);
+    out.sse.assign(nlambda, 0.0);
+    out.func_norm.assign((size_t)nlambda * d, 0.0);
+    out.iterations.assign(nlambda, 0);
+    out.strong_set.assign(nlambda, d);
+    out.kkt_violations.assign(nlambda, 0);
+    out.safe_set.assign(nlambda, d);
+    out.gap.assign(nlambda, std::numeric_limits<double>::quiet_NaN());
+    out.working_set.assign(nlambda, d);
+    out.intercept.assign(nlambda, 0.0);
+    out.gram_cached.assign(nlambda, 0);
+    out.alo.assign(nlambda, std::numeric_limits<double>::quiet_NaN());
+    Criteria criteria = parse_criteria(opt.criteria);
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    out.edf.assign(nlambda, nan);
+    out.gcv.assign(nlambda, nan);
+    out.aic.assign(nlambda, nan);
+    out.bic.assign(nlambda, nan);
+    out.ebic.assign(nlambda, nan);
+
+    double lambda_prev = lambda_max;
+    bool at_zero = true;
+    vector<double> fit(n);
+    for (int l = 0; l < nlambda; l++) {
+      double lam = out.lambda[l];
+      S.reset_batch();
+      if (warm) {
+        S.start_from(warm + (size_t)l * d * p);
+        at_zero = true;
+        for (int j = 0; j < d && at_zero; j++)
+          at_zero = !S.nonzero(j);
+      }
+      if (at_zero && lam >= lambda_max) {
+        // w = 0 is exact here. Solving anyway could leave a round-off sized
+        // group at lambda_max, where the threshold test is a tie.
+        out.strong_set[l] = out.safe_set[l] = out.working_set[l] = 0;
+        if (Policy::kind == L1)
+          out.gap[l] = 0;
+      } else if (opt.working_set) {
+        out.iterations[l] = S.solve_working_set(lam, screening == SCREEN_GAP_SAFE, opt.max_ite, opt.thol, out.working_set[l], out.gap[l]);
+      } else if (screening == SCREEN_GAP_SAFE) {
+        out.iterations[l] = S.solve_gap_safe(lam, opt.max_ite, opt.thol, out.safe_set[l], out.gap[l]);
+      } else {
+        out.iterations[l] = S.solve_strong(lam, lambda_prev, screening == SCREEN_STRONG, opt.max_ite, opt.thol, out.strong_set[l], out.kkt_violations[l]);
+        if (Policy::kind == L1) {
+          double s;
+          out.gap[l] = S.duality_gap(lam, s);
+        }
+      }
+
+      std::copy(S.w, S.w + (size_t)d * p, &out.w[(size_t)l * d * p]);
+      out.sse[l] = S.rss();
+      for (int j = 0; j < d; j++) {
+        if (!S.nonzero(j))
+          continue;
+        out.df[l]++;
+        out.func_norm[(size_t)l * d + j] = S.func_norm(j, fit);
+      }
+      out.gram_cached[l] = cache.cached();
+      if (opt.alo || criteria != CRITERIA_OFF) {
+        vector<int> act = S.active();
+        // auto takes the exact trace whenever ALO has paid for the leverages.
+        bool exact = criteria == CRITERIA_EXACT || (criteria == CRITERIA_AUTO && (opt.alo || (int)act.size() * p <= kExactTrace));
+        Eigen::VectorXd h;
+        if (opt.alo || exact)
+          h = S.leverages(act, lam);
+        if (opt.alo)
+          out.alo[l] = S.alo_risk(act, h);
+        if (criteria != CRITERIA_OFF) {
+          out.edf[l] = exact ? h.sum() : S.hutchinson_trace(act, lam);
+          information_criteria(out, l, opt.ebic_gamma);
+        }
+      }
+      at_zero = out.df[l] == 0;
+      lambda_prev = lam;
+    }
+  }
+
+  // Picks the solver specialized for X.p, once per fit. The common basis
+  // sizes 3, 4, 5, 6, 8 and 10 have one; anything else runs the generic
+  // solver (P = 0).
+  template <class Policy, class Design>
+  static void solve_sized(const Design& X, const double* y, const vector<double>& lambda, const SolverOptions& opt, const Policy& penalty, GrpLassoWorkspace& ws, PathResult& out, const double* warm, const GramDowndate<Design>* gram) {
+    switch (opt.specialize ? X.p : 0) {
+    case 3: solve_path<3>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    case 4: solve_path<4>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    case 5: solve_path<5>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    case 6: solve_path<6>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    case 8: solve_path<8>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    case 10: solve_path<10>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    default: solve_path<0>(X, y, lambda, opt, penalty, ws, out, warm, gram); break;
+    }
+  }
+
+  // Resolves regfunc and gamma into a penalty policy, once per fit.
+  template <class Design>
+  static void solve_path(const Design& X, const double* y, const vector<double>& lambda, const SolverOptions& opt, GrpLassoWorkspace& ws, PathResult& out, const double* warm, const GramDowndate<Design>* gram) {
+    Penalty pen = parse_penalty(opt.regfunc);
+    double gamma = opt.gamma > 0 ? opt.gamma : (pen == SCAD ? 3.7 : 3);
+    switch (pen) {
+    case MCP:
+      if (gamma <= 1)
+        throw std::invalid_argument("MCP needs gamma > 1");
+      solve_sized(X, y, lambda, opt, MCPPenalty(gamma), ws, out, warm, gram);
+      break;
+    case SCAD:
+      if (gamma <= 2)
+        throw std::invalid_argument("SCAD needs gamma > 2");
+      solve_sized(X, y, lambda, opt, SCADPenalty(gamma), ws, out, warm, gram);
+      break;
+    default:
+      solve_sized(X, y, lambda, opt, L1Penalty(), ws, out, warm, gram);
+    }
+  }
+
+  // Gram column j of a transformed design from X^T X_j of the original one
+  // (n rows), block by block: Xt_k^T Xt_j = T_k^T (X_k^T X_j - n mean_k
+  // mean_j^T) T_j. Both columns are column-major (d*p) x p.
+  static void transform_gram_column(const GroupTransform& tf, int n, int j, const double* in, double* out) {
+    typedef Eigen::Map<const Eigen::MatrixXd> ConstMap;
+    typedef Eigen::OuterStride<> Stride;
+    int d = tf.d, p = tf.p;
+    size_t m = (size_t)d * p;
+    ConstMap Tj(&tf.T[(size_t)j * p * p], p, p);
+    Eigen::Map<const Eigen::VectorXd> muj(&tf.mean[(size_t)j * p], p);
+    for (int k = 0; k < d; k++) {
+      ConstMap Tk(&tf.T[(size_t)k * p * p], p, p);
+      Eigen::Map<const Eigen::VectorXd> muk(&tf.mean[(size_t)k * p], p);
+      Eigen::MatrixXd G = Eigen::Map<const Eigen::MatrixXd, 0, Stride>(in + (size_t)k * p, p, p, Stride(m));
+      G -= n * muk * muj.transpose();
+      Eigen::Map<Eigen::MatrixXd, 0, Stride>(out + (size_t)k * p, p, p, Stride(m)) = Tk.transpose() * G * Tj;
+    }
+  }
+
+  template <class Design>
+  void grplasso_path(const Design& X, const double* y, const vector<double>& lambda, const SolverOptions& opt, GrpLassoWorkspace& ws, PathResult& out, const GroupTransform* transform, const double* warm, const GramDowndate<Design>* gram) {
+    if (!transform && !opt.orthonormalize) {
+      solve_path(X, y, lambda, opt, ws, out, warm, gram);
+      return;
+    }
+    GroupTransform local;
+    if (!transform) {
+      local.fit(X, true);
+      transform = &local;
+    }
+    if (transform->d != X.d || transform->p != X.p)
+      throw std::invalid_argument("transform was fitted on a design of another shape");
+
+    // Solve in the transformed basis (orthonormal: every block update is an
+    // exact group threshold), then map back. Centering moves into the
+    // intercept.
+    int n = X.n, d = X.d, p = X.p;
+    double ybar = 0;
+    vector<double> yc(y, y + n);
+    if (transform->centered) {
+      for (int i = 0; i < n; i++)
+        ybar += y[i] / n;
+      for (int i = 0; i < n; i++)
+        yc[i] -= ybar;
+    }
+    vector<double> warm_t;
+    if (warm) {
+      size_t m = (size_t)d * p;
+      warm_t.resize(lambda.size() * m);
+      for (size_t l = 0; l < lambda.size(); l++)
+        transform->to_transformed(warm + l * m, &warm_t[l * m]);
+    }
+
+    // Gram columns come from X's own (possibly downdated) ones.
+    std::unique_ptr<GramCache<Design> > raw(gram ? new GramCache<Design>(X, gram) : NULL);
+    vector<vector<double> > cols(gram ? d : 0);
+    GramDowndate<OrthoDesign<Design> > mapped = {[&](int j) {
+      cols[j].resize((size_t)d * p * p);
+      transform_gram_column(*transform, n, j, raw->column(j), cols[j].data());
+      return (const double*)cols[j].data();
+    }, NULL};
+    solve_path(OrthoDesign<Design>(X, *transform), yc.data(), lambda, opt, ws, out, warm ? warm_t.data() : NULL, gram ? &mapped : NULL);
+
+    vector<double> wt((size_t)d * p);
+    for (int l = 0; l < out.nlambda; l++) {
+      double* w = &out.w[(size_t)l * d * p];
+      std::copy(w, w + (size_t)d * p, wt.begin());
+      transform->to_original(wt.data(), w);
+      out.intercept[l] = ybar;
+      for (int a = 0; a < d * p; a++)
+        out.intercept[l] -= transform->mean[a] * w[a];
+    }
+  }
+
+  template void grplasso_path<DenseDesign>(const DenseDesign&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<DenseDesign>*);
+  template void grplasso_path<DenseDesignF>(const DenseDesignF&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<DenseDesignF>*);
+  template void grplasso_path<BandedDesign>(const BandedDesign&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<BandedDesign>*);
+  template void grplasso_path<BandedDesignF>(const BandedDesignF&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<BandedDesignF>*);
+  template void grplasso_path<BinnedDesign>(const BinnedDesign&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<BinnedDesign>*);
+  template void grplasso_path<RowSubsetDesign>(const RowSubsetDesign&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<RowSubsetDesign>*);
+  template void grplasso_path<RowSubsetDesignF>(const RowSubsetDesignF&, const double*, const vector<double>&, const SolverOptions&, GrpLassoWorkspace&, PathResult&, const GroupTransform*, const double*, const GramDowndate<RowSubsetDesignF>*);
+}
@@ -0,0 +1,195 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "workspace.h"
+#include "ortho.h"
+#include "gram.h"
+using std::string;
+using std::vector;
+
+namespace SAM {
+  enum Penalty { L1, MCP, SCAD };
+  enum Screening { SCREEN_NONE, SCREEN_STRONG, SCREEN_GAP_SAFE };
+  enum Criteria { CRITERIA_OFF, CRITERIA_EXACT, CRITERIA_HUTCHINSON, CRITERIA_AUTO };
+
+  // "L1", "MCP" or "SCAD"; throws std::invalid_argument otherwise.
+  extern Penalty parse_penalty(const string& regfunc);
+  // "none", "strong" or "gap_safe"; throws std::invalid_argument otherwise.
+  extern Screening parse_screening(const string& screening);
+  // "off", "exact", "hutchinson" or "auto"; throws std::invalid_argument
+  // otherwise.
+  extern Criteria parse_criteria(const string& criteria);
+
+  // Penalty policies. The path solver is compiled once per policy, so the
+  // group threshold and its parameters inline into the block update.
+  // threshold(z, lambda, L) is the minimizer over t >= 0 of
+  // L/2 (t - z)^2 + pen(t), z >= 0: the norm of a group after a majorized
+  // block update with curvature L. The non-convex penalties need
+  // L > curvature_floor() for that problem to be convex. derivative and
+  // second_derivative are pen'(t) and pen''(t) for t > 0.
+  struct L1Penalty {
+    static const Penalty kind = L1;
+    double threshold(double z, double lambda, double L) const {
+      return std::max(0.0, z - lambda / L);
+    }
+    double curvature_floor() const { return 0; }
+    double derivative(double, double lambda) const { return lambda; }
+    double second_derivative(double, double) const { return 0; }
+  };
+
+  // gamma > 1 is the concavity parameter.
+  struct MCPPenalty {
+    static const Penalty kind = MCP;
+    explicit MCPPenalty(double gamma) : gamma(gamma) {}
+    double threshold(double z, double lambda, double L) const {
+      if (z > gamma * lambda)
+        return z;
+      return std::max(0.0, L * z - lambda) / (L - 1 / gamma);
+    }
+    double curvature_floor() const { return 1 / gamma; }
+    double derivative(double t, double lambda) const {
+      return std::max(0.0, lambda - t / gamma);
+    }
+    double second_derivative(double t, double lambda) const {
+      return t < gamma * lambda ? -1 / gamma : 0;
+    }
+    double gamma;
+  };
+
+  // gamma > 2 is the concavity parameter.
+  struct SCADPenalty {
+    static const Penalty kind = SCAD;
+    explicit SCADPenalty(double gamma) : gamma(gamma) {}
+    double threshold(double z, double lambda, double L) const {
+      if (z > gamma * lambda)
+        return z;
+      if (z > lambda + lambda / L)
+        return (L * (gamma - 1) * z - gamma * lambda) / (L * (gamma - 1) - 1);
+      return std::max(0.0, z - lambda / L);
+    }
+    double curvature_floor() const { return 1 / (gamma - 1); }
+    double derivative(double t, double lambda) const {
+      if (t <= lambda)
+        return lambda;
+      return std::max(0.0, (gamma * lambda - t) / (gamma - 1));
+    }
+    double second_derivative(double t, double lambda) const {
+      return t > lambda && t < gamma * lambda ? -1 / (gamma - 1) : 0;
+    }
+    double gamma;
+  };
+
+  // The policies' threshold for a penalty chosen at run time.
+  extern double threshold(Penalty pen, double z, double lambda, double gamma, double L);
+
+  struct SolverOptions {
+    int max_ite = 1000;
+    double thol = 1e-4;
+    string regfunc = "L1";
+    // Concavity of MCP / SCAD; 0 picks the usual 3 and 3.7.
+    double gamma = 0;
+    // Nonzero when lambda holds absolute values; otherwise they are ratios
+    // of lambda_max, as with the legacy `input` argument.
+    int lambda_input = 1;
+    // "strong" (heuristic, KKT checked) stops when no block moves by more
+    // than thol. "gap_safe" (L1 only) never drops an active group and stops
+    // when the duality gap is below thol times ||y||^2 / (2n).
+    string screening = "strong";
+    // Solve over a growing working set of prioritized groups instead of
+    // sweeping the screened set; see BlockSolver::solve_working_set.
+    // "gap_safe" screening still applies, "strong" is not needed.
+    bool working_set = false;
+    // Center and orthonormalize every group first (see GroupTransform), so
+    // each block update is a closed-form group threshold. The penalty then
+    // applies to ||X_j w_j|| / sqrt(n) rather than ||w_j||, and y need not
+    // be centered.
+    bool orthonormalize = false;
+    // Covariance updates through lazily cached cross-Gram blocks (see
+    // GramCache): "on", "off", or "auto" to use them when n >> d*p.
+    string covariance = "auto";
+    // Use the solver compiled for the group size when p is one of the
+    // specialized sizes; false always runs the generic one.
+    bool specialize = true;
+    // Update batches of groups concurrently from the same residual
+    // (Jacobi-style), merging their residual changes chunk by chunk. A batch
+    // whose combined move the per-group curvature bounds do not cover is
+    // redone serially and later batches are halved (they double again after
+    // a batch that passes, and every lambda starts from full batches), so
+    // every step still descends and the fixed point is the serial one. Meant
+    // for very large d; covariance mode always updates serially.
+    bool parallel_cd = false;
+    // Cross-validation only: folds in covariance mode take each Gram
+    // column from the full-data one, computed once and shared, minus their
+    // held-out rows (see GramDowndate), mapped through each fold's
+    // centering / orthonormalizing transform.
+    bool cv_gram = true;
+    // Approximate leave-one-out risk per lambda (PathResult::alo).
+    bool alo = false;
+    // Effective degrees of freedom and GCV / AIC / BIC / eBIC per lambda:
+    // "exact" traces the active-set smoother, "hutchinson" estimates the
+    // trace from random probes, "auto" picks the estimate for large active
+    // sets, and "off" skips them. ebic_gamma weighs eBIC's model-space term.
+    string criteria = "off";
+    double ebic_gamma = 0.5;
+  };
+
+  // Solution path of min_w 1/(2n) ||y - X w||^2 + sum_j pen(||w_j||; lambda).
+  // y and the columns of X are expected to be centered.
+  struct PathResult {
+    int n, d, p, nlambda;
+    vector<double> lambda;      // lambda actually used
+    vector<double> w;           // w[l*d*p + j*p + k]
+    vector<int> df;             // nonzero groups per lambda
+    vector<double> sse;         // ||y - X w||^2 per lambda
+    vector<double> func_norm;   // ||X_j w_j|| / sqrt(n), [l*d + j]
+    vector<int> iterations;     // block sweeps per lambda
+    // Screening statistics per lambda: groups kept by the strong rule and
+    // discarded groups that failed the KKT check and were added back.
+    vector<int> strong_set;
+    vector<int> kkt_violations;
+    // Groups surviving the gap-safe tests, and the final duality gap (L1
+    // only, NaN otherwise).
+    vector<int> safe_set;
+    vector<double> gap;
+    // Size of the final working set (working_set mode only).
+    vector<int> working_set;
+    // Intercept per lambda when the groups were centered, otherwise 0.
+    vector<double> intercept;
+    // Groups with cached Gram blocks after each lambda (covariance mode).
+    vector<int> gram_cached;
+    // Approximate leave-one-out mean squared error (with opt.alo, NaN
+    // otherwise): each residual is inflated by 1 / (1 - h_ii), h the
+    // leverages of the active groups under the penalty's curvature at the
+    // solution, plus 1/n for the intercept that centering y implies. NaN
+    // where that curvature is not positive definite, inf where some
+    // h_ii + 1/n >= 1.
+    vector<double> alo;
+    // With opt.criteria (NaN otherwise): effective df tr(H), H the smoother
+    // of the active groups (see alo), and the Gaussian criteria
+    //   gcv  = sse/n / (1 - k/n)^2
+    //   aic  = n log(sse/n) + 2 k
+    //   bic  = n log(sse/n) + log(n) k
+    //   ebic = bic + 2 ebic_gamma log C(d, df)
+    // with k = edf + 1 for the intercept. aic, bic and ebic are NaN for an
+    // interpolating fit (sse = 0), where the Gaussian likelihood is unbounded.
+    vector<double> edf, gcv, aic, bic, ebic;
+  };
+
+  // Block coordinate descent along the lambda path, warm-started from one
+  // lambda to the next. Design is DenseDesign, BandedDesign or BinnedDesign;
+  // residual and coefficient scratch come from ws. A precomputed transform
+  // (orthonormalizing, or centering only) takes the place of
+  // opt.orthonormalize; coefficients are always returned in the original
+  // basis, with the intercept the centering implies. With `warm`
+  // (nlambda*d*p coefficients in the original basis, e.g. a path fitted on
+  // more data) the solve at lambda[l] starts from warm[l*d*p ...] instead of
+  // from the previous solution. In covariance mode, `gram` supplies the Gram
+  // columns of X, mapped through the transform if there is one.
+  template <class Design>
+  void grplasso_path(const Design& X, const double* y, const vector<double>& lambda, const SolverOptions& opt, GrpLassoWorkspace& ws, PathResult& out, const GroupTransform* transform = NULL, const double* warm = NULL, const GramDowndate<Design>* gram = NULL);
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+namespace SAM {
+  class ThreadPool {
+  public:
+    explicit ThreadPool(int nthreads) : job(NULL), count(0), grain(1), pending(0), generation(0), stop(false) {
+      for (int t = 1; t < nthreads; t++)
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(mu);
+        stop = true;
+      }
+      wake.notify_all();
+      for (auto& th : workers)
+        th.join();
+    }
+
+    int size() const {
+      return workers.size() + 1;
+    }
+
+    void run(int n, int g, const std::function<void(int)>& f) {
+      {
+        std::lock_guard<std::mutex> lock(mu);
+        job = &f, count = n, grain = g;
+        next = 0;
+        pending = workers.size();
+        error = nullptr;
+        generation++;
+      }
+      wake.notify_all();
+      work(f, n, g);
+      std::unique_lock<std::mutex> lock(mu);
+      done.wait(lock, [this]() { return pending == 0; });
+      job = NULL;
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+  private:
+    void work(const std::function<void(int)>& f, int n, int g) {
+      while (true) {
+        int start = next.fetch_add(g);
+        if (start >= n)
+          return;
+        try {
+          for (int i = start; i < std::min(n, start + g); i++)
+            f(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mu);
+          if (!error)
+            error = std::current_exception();
+          next = n;
+        }
+      }
+    }
+
+    void worker_loop();
+
+    vector<std::thread> workers;
+    std::mutex mu;
+    std::condition_variable wake, done;
+    const std::function<void(int)>* job;
+    int count, grain, pending;
+    std::atomic<int> next;
+    unsigned generation;
+    bool stop;
+    std::exception_ptr error;
+  };
+
+  // Set while a thread is executing pool work, so nested calls run inline.
+  static thread_local bool in_pool = false;
+
+  void ThreadPool::worker_loop() {
+    in_pool = true;
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lock(mu);
+    while (true) {
+      wake.wait(lock, [&]() { return stop || generation != seen; });
+      if (stop)
+        return;
+      seen = generation;
+      const std::function<void(int)>& f = *job;
+      int n = count, g = grain;
+      lock.unlock();
+      work(f, n, g);
+      lock.lock();
+      if (--pending == 0)
+        done.notify_one();
+    }
+  }
+
+  static int default_threads() {
+    const char* env = std::getenv("OMP_NUM_THREADS");
+    // OMP_NUM_THREADS may list one count per nesting level; the first one
+    // is ours.
+    int n = env ? std::atoi(env) : 0;
+    if (n <= 0)
+      n = std::thread::hardware_concurrency();
+    return std::max(n, 1);
+  }
+
+  // The pool is owned by whoever holds run_mu. It is never destroyed at
+  // exit: joining threads from static destructors can deadlock inside a
+  // Python extension.
+  static std::mutex run_mu;
+  static ThreadPool* pool = NULL;
+  static int nthreads = 0;
+
+  void set_num_threads(int n) {
+    std::lock_guard<std::mutex> lock(run_mu);
+    delete pool;
+    pool = NULL;
+    nthreads = n > 0 ? n : default_threads();
+  }
+
+  int get_num_threads() {
+    std::lock_guard<std::mutex> lock(run_mu);
+    if (nthreads == 0)
+      nthreads = default_threads();
+    return nthreads;
+  }
+
+  void parallel_for(int count, const std::function<void(int)>& f, int grain) {
+    grain = std::max(grain, 1);
+    std::unique_lock<std::mutex> lock(run_mu, std::defer_lock);
+    if (count > grain && !in_pool && lock.try_lock()) {
+      if (nthreads == 0)
+        nthreads = default_threads();
+      if (nthreads > 1) {
+        if (!pool)
+          pool = new ThreadPool(nthreads);
+        in_pool = true;
+        try {
+          pool->run(count, grain, f);
+        } catch (...) {
+          in_pool = false;
+          throw;
+        }
+        in_pool = false;
+        return;
+      }
+    }
+    for (int i = 0; i < count; i++)
+      f(i);
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <functional>
+
+namespace SAM {
+  // One process-wide pool of worker threads shared by every parallel stage
+  // (basis expansion, gradient passes, CV folds, ...). It is created on
+  // first use with OMP_NUM_THREADS threads, or one per hardware thread when
+  // that is unset, and the calling thread always counts as one of them.
+
+  // Resizes the pool; nthreads <= 0 restores the default. Waits for a
+  // running parallel_for to finish.
+  extern void set_num_threads(int nthreads);
+  extern int get_num_threads();
+
+  // Runs f(i) for every i in [0, count), handing out `grain` consecutive
+  // indices at a time. The caller works too and returns once all are done;
+  // the first exception thrown by f is rethrown here. Calls made from
+  // inside f, or while another thread owns the pool, run serially.
+  extern void parallel_for(int count, const std::function<void(int)>& f, int grain = 1);
+}
+
+#endif
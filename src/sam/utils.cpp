@@ -1,11 +1,12 @@
 #include "utils.h"
+#include "kernels.h"
 
 namespace SAM {
   double calc_norm(const VectorXd &x) {
-    double res = 0;
-    for (int i = 0; i < x.size(); i++)
-      res += x(i) * x(i);
-    return sqrt(res);
+    return sqrt(sumsq(x.data(), x.size()));
+  }
+  double calc_norm(const double* x, int len) {
+    return sqrt(sumsq(x, len));
   }
   double sqr(double x) {
     return x * x;
@@ -6,6 +6,7 @@ using Eigen::VectorXd;
 
 namespace SAM {
   extern double calc_norm(const VectorXd &x);
+  extern double calc_norm(const double* x, int len);
   extern double sqr(double x);
 }
 
@@ -0,0 +1,88 @@
+#include "workspace.h"
+#include <new>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace SAM {
+  static const size_t kHugePage = 2 << 20;
+
+  double* aligned_alloc_doubles(size_t count, bool huge_pages) {
+    size_t bytes = count * sizeof(double);
+    if (bytes == 0)
+      return NULL;
+    size_t align = kAlignment;
+    if (huge_pages && bytes >= kHugePage)
+      align = kHugePage;
+    // Round up so the tail of the region never shares a cache line (or huge
+    // page) with another allocation.
+    bytes = (bytes + align - 1) / align * align;
+    void* ptr = NULL;
+#ifdef _WIN32
+    ptr = _aligned_malloc(bytes, align);
+#else
+    if (posix_memalign(&ptr, align, bytes) != 0)
+      ptr = NULL;
+#endif
+    if (ptr == NULL)
+      throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (align == kHugePage)
+      madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+    return static_cast<double*>(ptr);
+  }
+
+  void aligned_free(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+
+  GrpLassoWorkspace::GrpLassoWorkspace(bool huge_pages) : huge_pages_(huge_pages), busy_(false) {
+    Buffer empty = {NULL, 0};
+    design_ = residual_ = coef_ = empty;
+  }
+
+  GrpLassoWorkspace::~GrpLassoWorkspace() {
+    aligned_free(design_.data);
+    aligned_free(residual_.data);
+    aligned_free(coef_.data);
+  }
+
+  void GrpLassoWorkspace::grow(Buffer& buf, size_t count) {
+    if (buf.capacity >= count)
+      return;
+    double* data = aligned_alloc_doubles(count, huge_pages_);
+    aligned_free(buf.data);
+    buf.data = data;
+    buf.capacity = count;
+  }
+
+  // Doubles of design storage for an (n, d*p) design with padded columns.
+  static size_t design_doubles(int n, int d, int p, bool single) {
+    size_t count = (size_t)padded_stride(n, single ? sizeof(float) : sizeof(double)) * d * p;
+    return single ? (count + 1) / 2 : count;
+  }
+
+  void GrpLassoWorkspace::reserve(int n, int d, int p, bool with_design, bool single) {
+    if (with_design)
+      grow(design_, design_doubles(n, d, p, single));
+    grow(residual_, n);
+    grow(coef_, (size_t)d * p);
+  }
+
+  bool GrpLassoWorkspace::compatible(int n, int d, int p, bool single) const {
+    return design_.capacity >= design_doubles(n, d, p, single) && residual_.capacity >= (size_t)n &&
+           coef_.capacity >= (size_t)d * p;
+  }
+
+  size_t GrpLassoWorkspace::nbytes() const {
+    return (design_.capacity + residual_.capacity + coef_.capacity) * sizeof(double);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace SAM {
+  // Alignment of every workspace buffer: one cache line, and enough for any
+  // SIMD load width we use.
+  const size_t kAlignment = 64;
+
+  // Column stride, in elements of elem_size bytes, of the padded design
+  // layout: n rounded up so that every column (and so every group block)
+  // of a kAlignment-aligned buffer starts on a cache line.
+  inline int padded_stride(int n, size_t elem_size) {
+    int per = kAlignment / elem_size;
+    return (n + per - 1) / per * per;
+  }
+
+  // Allocates `count` doubles aligned to kAlignment. With `huge_pages`, large
+  // regions are aligned to 2MB and advised for transparent huge pages.
+  extern double* aligned_alloc_doubles(size_t count, bool huge_pages);
+  extern void aligned_free(void* ptr);
+
+  // Scratch memory for one group lasso fit: the design in the solver's
+  // j*p*ld + k*ld + i layout with ld = padded_stride(n), the residual (n)
+  // and the coefficients (d*p). Buffers only ever grow, so a workspace that
+  // is reused across fits of compatible shape allocates (and faults in) its
+  // memory once.
+  class GrpLassoWorkspace {
+  public:
+    explicit GrpLassoWorkspace(bool huge_pages = false);
+    ~GrpLassoWorkspace();
+
+    // Without `with_design` only the residual and coefficient buffers are
+    // sized, for solvers that read a compressed design. With `single` the
+    // design is sized for float32 storage; design() is then reinterpreted as
+    // float*.
+    void reserve(int n, int d, int p, bool with_design = true, bool single = false);
+    // Whether reserve(n, d, p, true, single) would not need to grow.
+    bool compatible(int n, int d, int p, bool single = false) const;
+    size_t nbytes() const;
+
+    // A workspace serves one fit at a time. try_acquire() claims it and
+    // returns false when another fit (e.g. from another Python thread)
+    // holds it; release() hands it back.
+    bool try_acquire() { return !busy_.exchange(true); }
+    void release() { busy_ = false; }
+
+    double* design() { return design_.data; }
+    double* residual() { return residual_.data; }
+    double* coef() { return coef_.data; }
+
+    GrpLassoWorkspace(const GrpLassoWorkspace&) = delete;
+    GrpLassoWorkspace& operator=(const GrpLassoWorkspace&) = delete;
+
+  private:
+    struct Buffer {
+      double* data;
+      size_t capacity;
+    };
+    void grow(Buffer& buf, size_t count);
+
+    bool huge_pages_;
+    Buffer design_, residual_, coef_;
+    std::atomic<bool> busy_;
+  };
+}
+
+#endif
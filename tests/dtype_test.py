@@ -0,0 +1,52 @@
+import unittest
+import numpy as np
+from sam import __grplasso_path as grplasso_path
+from sam import __grplasso_array as grplasso_array
+from sam import GrpLassoWorkspace
+import sam
+
+
+class DtypeTest(unittest.TestCase):
+    def setUp(self):
+        rng = np.random.RandomState(0)
+        self.n, self.d, self.p = 60, 4, 3
+        self.X = rng.uniform(-1, 1, (self.n, self.d * self.p))
+        self.y = self.X[:, 0] - 0.5 * self.X[:, 4] + 0.1 * rng.randn(self.n)
+        self.lbd = [0.5, 0.2, 0.1]
+
+    def test_list_is_float64(self):
+        ref = grplasso_path(self.y, self.X, self.lbd, self.p)
+        fit = grplasso_path(self.y, self.X.tolist(), self.lbd, self.p)
+        np.testing.assert_array_equal(fit.w, ref.w)
+
+    def test_int_array_is_float64(self):
+        Xi = np.round(10 * self.X).astype(np.int16)
+        ref = grplasso_path(self.y, Xi.astype(np.float64), self.lbd, self.p)
+        fit = grplasso_path(self.y, Xi, self.lbd, self.p)
+        np.testing.assert_array_equal(fit.w, ref.w)
+
+    def test_float32_stays_single(self):
+        # Through the Python API, with a list lambda and no transform, a
+        # (C-ordered, so copied) float32 X is stored in the workspace as
+        # floats: padded_stride(n) floats per column, not doubles.
+        X32 = self.X.astype(np.float32)
+        ws = GrpLassoWorkspace()
+        fit = sam.grplasso_path(self.y, X32, self.lbd, p=self.p, workspace=ws)
+        n, m = self.n, self.d * self.p
+        ld = -(-n // 16) * 16
+        self.assertEqual(ws.nbytes, 8 * ((ld * m + 1) // 2 + n + m))
+        ref = grplasso_path(self.y, X32.astype(np.float64), self.lbd, self.p)
+        np.testing.assert_allclose(fit.w, ref.w, atol=1e-5)
+
+    def test_read_only_x_is_copied_for_legacy_solver(self):
+        X = np.asfortranarray(self.X)
+        ref = grplasso_array(self.y, X, self.lbd, 1000, 1e-6, 'L1', 1, self.p)
+        X.setflags(write=False)
+        fit = grplasso_array(self.y, X, self.lbd, 1000, 1e-6, 'L1', 1, self.p)
+        for a, b in zip(fit, ref):
+            np.testing.assert_array_equal(a, b)
+        np.testing.assert_array_equal(X, self.X)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,172 @@
+#include <catch.hpp>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "basis.h"
+#include "banded.h"
+#include "binned.h"
+
+using std::vector;
+
+// Cox-de Boor recursion, straight from the definition.
+static double naive_bspline(const vector<double>& t, int k, int degree, double x) {
+  if (degree == 0)
+    return (t[k] <= x && x < t[k + 1]) ? 1 : 0;
+  double a = 0, b = 0;
+  if (t[k + degree] > t[k])
+    a = (x - t[k]) / (t[k + degree] - t[k]) * naive_bspline(t, k, degree - 1, x);
+  if (t[k + degree + 1] > t[k + 1])
+    b = (t[k + degree + 1] - x) / (t[k + degree + 1] - t[k + 1]) * naive_bspline(t, k + 1, degree - 1, x);
+  return a + b;
+}
+
+TEST_CASE("B-spline basis expansion")
+{
+  const int n = 150, d = 3, p = 7, degree = 3, nknots = p + degree + 1;
+  vector<double> x(n * d);
+  for (int i = 0; i < n * d; i++)
+    x[i] = std::sin(0.37 * i) * (1 + i % d);
+
+  vector<double> knots(d * nknots);
+  SAM::bspline_knots(x.data(), n, d, p, degree, knots.data());
+  vector<double> XX(n * d * p);
+  SAM::bspline_basis(x.data(), n, d, knots.data(), nknots, degree, XX.data());
+
+  for (int j = 0; j < d; j++) {
+    vector<double> t(knots.begin() + j * nknots, knots.begin() + (j + 1) * nknots);
+    for (int i = 0; i < n; i++) {
+      double sum = 0;
+      for (int k = 0; k < p; k++) {
+        double v = XX[j * p * n + k * n + i];
+        sum += v;
+        // The naive recursion is right-open, so skip the right boundary.
+        if (x[j * n + i] < t[nknots - 1])
+          REQUIRE(v == Approx(naive_bspline(t, k, degree, x[j * n + i])));
+      }
+      REQUIRE(sum == Approx(1.0));
+    }
+  }
+}
+
+TEST_CASE("Banded spline design matches the dense kernels")
+{
+  const int n = 200, d = 2, p = 9, degree = 3, nknots = p + degree + 1;
+  vector<double> x(n * d), r(n);
+  for (int i = 0; i < n * d; i++)
+    x[i] = std::cos(1.3 * i);
+  for (int i = 0; i < n; i++)
+    r[i] = std::sin(0.7 * i);
+
+  vector<double> knots(d * nknots), XX(n * d * p), dense(n * d * p);
+  SAM::bspline_knots(x.data(), n, d, p, degree, knots.data());
+  SAM::bspline_basis(x.data(), n, d, knots.data(), nknots, degree, XX.data());
+  SAM::BandedDesign B;
+  SAM::bspline_banded(x.data(), n, d, knots.data(), nknots, degree, B);
+  B.to_dense(dense.data());
+  for (int a = 0; a < n * d * p; a++)
+    REQUIRE(dense[a] == XX[a]);
+
+  for (int j = 0; j < d; j++) {
+    vector<double> g(p), delta(p), r1(r), r2(r);
+    B.xtr(j, r.data(), g.data());
+    for (int k = 0; k < p; k++) {
+      double ref = 0;
+      for (int i = 0; i < n; i++)
+        ref += XX[j * p * n + k * n + i] * r[i];
+      REQUIRE(g[k] == Approx(ref));
+      delta[k] = 0.1 * (k + 1);
+    }
+    B.axpy(j, delta.data(), r1.data());
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < p; k++)
+        r2[i] -= XX[j * p * n + k * n + i] * delta[k];
+      REQUIRE(r1[i] == Approx(r2[i]));
+    }
+  }
+}
+
+TEST_CASE("Binned spline design")
+{
+  const int n = 500, d = 2, p = 6, degree = 3, nknots = p + degree + 1;
+  vector<double> x(n * d), r(n);
+  for (int i = 0; i < n; i++) {
+    x[i] = i % 17;                 // few distinct values: binning is exact
+    x[n + i] = std::sin(0.01 * i); // many: quantile bins
+    r[i] = std::cos(0.3 * i);
+  }
+
+  vector<double> knots(d * nknots), XX(n * d * p), dense(n * d * p);
+  SAM::bspline_knots(x.data(), n, d, p, degree, knots.data());
+  SAM::bspline_basis(x.data(), n, d, knots.data(), nknots, degree, XX.data());
+  SAM::BinnedDesign H;
+  SAM::bspline_binned(x.data(), n, d, knots.data(), nknots, degree, 32, H);
+  H.to_dense(dense.data());
+
+  REQUIRE(H.nbins[0] == 17);
+  REQUIRE(H.nbins[1] <= 32);
+  for (int a = 0; a < n * p; a++)
+    REQUIRE(dense[a] == Approx(XX[a]));
+
+  for (int j = 0; j < d; j++) {
+    vector<double> g(p), delta(p), r1(r), r2(r);
+    H.xtr(j, r.data(), g.data());
+    for (int k = 0; k < p; k++) {
+      double ref = 0;
+      for (int i = 0; i < n; i++)
+        ref += dense[j * p * n + k * n + i] * r[i];
+      REQUIRE(g[k] == Approx(ref));
+      delta[k] = 1.0 - 0.2 * k;
+    }
+    H.axpy(j, delta.data(), r1.data());
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < p; k++)
+        r2[i] -= dense[j * p * n + k * n + i] * delta[k];
+      REQUIRE(r1[i] == Approx(r2[i]));
+    }
+  }
+}
+
+TEST_CASE("Binned spline design edge cases")
+{
+  const int n = 40, p = 5, degree = 3, nknots = p + degree + 1;
+  vector<double> x(n), knots(nknots), XX(n * p), dense(n * p);
+  for (int i = 0; i < n; i++)
+    x[i] = 0.1 * i;
+  SAM::bspline_knots(x.data(), n, 1, p, degree, knots.data());
+
+  // A single bin holds every sample at the mean of x.
+  SAM::BinnedDesign H;
+  SAM::bspline_binned(x.data(), n, 1, knots.data(), nknots, degree, 1, H);
+  REQUIRE(H.nbins[0] == 1);
+  double mean = 0;
+  for (int i = 0; i < n; i++)
+    mean += x[i] / n;
+  vector<double> rep(p);
+  SAM::bspline_basis(&mean, 1, 1, knots.data(), nknots, degree, rep.data());
+  H.to_dense(dense.data());
+  for (int k = 0; k < p; k++)
+    for (int i = 0; i < n; i++)
+      REQUIRE(dense[k * n + i] == Approx(rep[k]));
+
+  x[7] = std::nan("");
+  REQUIRE_THROWS_AS(SAM::bspline_binned(x.data(), n, 1, knots.data(), nknots, degree, 16, H), const std::invalid_argument&);
+}
+
+TEST_CASE("Spline expansions reject non-finite features")
+{
+  const int n = 40, p = 5, degree = 3, nknots = p + degree + 1;
+  vector<double> x(2 * n), knots(2 * nknots), XX(2 * n * p);
+  for (int i = 0; i < 2 * n; i++)
+    x[i] = 0.1 * i;
+  SAM::bspline_knots(x.data(), n, 2, p, degree, knots.data());
+
+  const double bad[] = {std::nan(""), HUGE_VAL, -HUGE_VAL};
+  for (double v : bad) {
+    x[n + 3] = v;
+    SAM::BandedDesign B;
+    REQUIRE_THROWS_AS(SAM::bspline_knots(x.data(), n, 2, p, degree, knots.data()), const std::invalid_argument&);
+    REQUIRE_THROWS_AS(SAM::bspline_basis(x.data(), n, 2, knots.data(), nknots, degree, XX.data()), const std::invalid_argument&);
+    REQUIRE_THROWS_AS(SAM::bspline_banded(x.data(), n, 2, knots.data(), nknots, degree, B), const std::invalid_argument&);
+  }
+}
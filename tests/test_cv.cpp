@@ -0,0 +1,280 @@
+#include <catch.hpp>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "cv.h"
+#include "design.h"
+#include "gram.h"
+#include "kernels.h"
+#include "solver.h"
+
+using std::vector;
+
+// Random nonnegative design, like a B-spline basis its columns do not have
+// zero mean, with signal in the first two groups.
+static void make_problem(int n, int d, int p, vector<double>& X, vector<double>& y) {
+  X.resize((size_t)n * d * p);
+  y.assign(n, 0.0);
+  unsigned seed = 777;
+  for (size_t a = 0; a < X.size(); a++) {
+    seed = seed * 1103515245 + 12345;
+    X[a] = ((seed >> 8) % 2000) / 1000.0;
+  }
+  for (int i = 0; i < n; i++) {
+    y[i] = 0.5 + 0.3 * std::sin(0.7 * i);
+    for (int j = 0; j < 2; j++)
+      for (int k = 0; k < p; k++)
+        y[i] += (k + 1.0) / (j + 1) * X[(size_t)(j * p + k) * n + i];
+  }
+}
+
+// The rows of X listed in rows, copied into a packed buffer.
+static vector<double> copy_rows(const vector<double>& X, int n, int m, const vector<int>& rows) {
+  vector<double> out((size_t)rows.size() * m);
+  for (int c = 0; c < m; c++)
+    for (size_t i = 0; i < rows.size(); i++)
+      out[c * rows.size() + i] = X[(size_t)c * n + rows[i]];
+  return out;
+}
+
+// Subtracts the column means of a packed n x m buffer; returns them.
+static vector<double> center(vector<double>& X, int n, int m) {
+  vector<double> mean(m, 0.0);
+  for (int c = 0; c < m; c++) {
+    for (int i = 0; i < n; i++)
+      mean[c] += X[(size_t)c * n + i] / n;
+    for (int i = 0; i < n; i++)
+      X[(size_t)c * n + i] -= mean[c];
+  }
+  return mean;
+}
+
+TEST_CASE("Row subsets of a dense design")
+{
+  int n = 50, d = 4, p = 3;
+  vector<double> X, y;
+  make_problem(n, d, p, X, y);
+  vector<int> rows;
+  for (int i = 0; i < n; i += 3)
+    rows.push_back(i);
+  int nr = rows.size();
+  vector<double> Xc = copy_rows(X, n, d * p, rows);
+
+  SAM::DenseDesign full(X.data(), n, d, p);
+  SAM::RowSubsetDesign sub(full, rows.data(), nr);
+  SAM::DenseDesign packed(Xc.data(), nr, d, p);
+  vector<double> r(nr), a(p), b(p), ra(nr), rb(nr), Ga(p * p), Gb(p * p);
+  for (int i = 0; i < nr; i++)
+    r[i] = ra[i] = rb[i] = std::cos(1.3 * i);
+  double delta[] = {0.5, 0, -2};
+  // The subset gathers its rows and runs the packed design's kernels, so
+  // under every kernel variant the two agree bit for bit.
+  string initial = SAM::kernel_variant();
+  for (const string& variant : SAM::kernel_variants()) {
+    SAM::select_kernels(variant);
+    for (int j = 0; j < d; j++) {
+      sub.xtr(j, r.data(), a.data());
+      packed.xtr(j, r.data(), b.data());
+      for (int k = 0; k < p; k++)
+        REQUIRE(a[k] == b[k]);
+      sub.axpy(j, delta, ra.data());
+      packed.axpy(j, delta, rb.data());
+      for (int i = 0; i < nr; i++)
+        REQUIRE(ra[i] == rb[i]);
+      sub.gram(j, Ga.data());
+      packed.gram(j, Gb.data());
+      for (int k = 0; k < p * p; k++)
+        REQUIRE(Ga[k] == Gb[k]);
+    }
+  }
+  SAM::select_kernels(initial);
+}
+
+TEST_CASE("K-fold cross-validation")
+{
+  int n = 120, d = 10, p = 4, K = 4, nlambda = 8;
+  vector<double> X, y;
+  make_problem(n, d, p, X, y);
+  vector<int> folds(n);
+  for (int i = 0; i < n; i++)
+    folds[i] = (i * 7) % K;
+  vector<double> lambda(nlambda);
+  for (int l = 0; l < nlambda; l++)
+    lambda[l] = std::pow(0.02, (double)l / (nlambda - 1));
+
+  SAM::DenseDesign full(X.data(), n, d, p);
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  SAM::CVResult cv;
+  SAM::cv_grplasso(full, y.data(), folds, lambda, opt, cv);
+  REQUIRE(cv.nfolds == K);
+  REQUIRE(cv.path.df.size() == (size_t)nlambda);
+  REQUIRE(cv.lambda == cv.path.lambda);
+
+  // The full-data path (f = -1) and every fold match a cold fit on
+  // explicitly centered copies of their rows of X and y.
+  SAM::SolverOptions cold = opt;
+  cold.lambda_input = 1;
+  for (int f = -1; f < K; f++) {
+    vector<int> train, test;
+    for (int i = 0; i < n; i++)
+      (folds[i] == f ? test : train).push_back(i);
+    int nt = train.size();
+    vector<double> Xt = copy_rows(X, n, d * p, train), yt(nt);
+    vector<double> xbar = center(Xt, nt, d * p);
+    double ybar = 0;
+    for (int i = 0; i < nt; i++)
+      ybar += y[train[i]] / nt;
+    for (int i = 0; i < nt; i++)
+      yt[i] = y[train[i]] - ybar;
+    SAM::GrpLassoWorkspace ws;
+    SAM::PathResult fit;
+    SAM::DenseDesign centered(Xt.data(), nt, d, p);
+    if (f < 0) {
+      SAM::grplasso_path(centered, yt.data(), lambda, opt, ws, fit);
+      for (int l = 0; l < nlambda; l++) {
+        REQUIRE(cv.lambda[l] == Approx(fit.lambda[l]).epsilon(1e-12));
+        double b0 = ybar;
+        for (int c = 0; c < d * p; c++) {
+          REQUIRE(cv.path.w[(size_t)l * d * p + c] == Approx(fit.w[(size_t)l * d * p + c]).margin(1e-6));
+          b0 -= xbar[c] * fit.w[(size_t)l * d * p + c];
+        }
+        REQUIRE(cv.path.intercept[l] == Approx(b0).margin(1e-6));
+      }
+      continue;
+    }
+    REQUIRE(cv.fold_size[f] == (int)test.size());
+    SAM::grplasso_path(centered, yt.data(), cv.lambda, cold, ws, fit);
+
+    for (int l = 0; l < nlambda; l++) {
+      const double* w = &fit.w[(size_t)l * d * p];
+      double loss = 0;
+      for (size_t a = 0; a < test.size(); a++) {
+        double pred = ybar;
+        for (int c = 0; c < d * p; c++)
+          pred += (X[(size_t)c * n + test[a]] - xbar[c]) * w[c];
+        loss += (y[test[a]] - pred) * (y[test[a]] - pred) / test.size();
+      }
+      REQUIRE(cv.fold_loss[(size_t)f * nlambda + l] == Approx(loss).epsilon(1e-6));
+    }
+  }
+
+  for (int l = 0; l < nlambda; l++) {
+    REQUIRE(cv.cvm[l] >= cv.cvm[cv.index_min]);
+    REQUIRE(cv.cvsd[l] >= 0);
+  }
+  REQUIRE(cv.lambda_min == cv.lambda[cv.index_min]);
+  REQUIRE(cv.lambda_1se >= cv.lambda_min);
+  REQUIRE(cv.cvm[cv.index_1se] <= cv.cvm[cv.index_min] + cv.cvsd[cv.index_min]);
+
+  // Warm starts map into each fold's own orthonormal basis.
+  SAM::SolverOptions ortho = opt;
+  ortho.orthonormalize = true;
+  SAM::CVResult cvo;
+  SAM::cv_grplasso(full, y.data(), folds, lambda, ortho, cvo);
+  for (int l = 0; l < nlambda; l++)
+    REQUIRE(std::isfinite(cvo.cvm[l]));
+  REQUIRE(cvo.cvm[nlambda - 1] < cvo.cvm[0]);
+
+  vector<int> one_fold(n, 0), short_folds(n - 1, 0);
+  REQUIRE_THROWS_AS(SAM::cv_grplasso(full, y.data(), one_fold, lambda, opt, cv), const std::invalid_argument&);
+  REQUIRE_THROWS_AS(SAM::cv_grplasso(full, y.data(), short_folds, lambda, opt, cv), const std::invalid_argument&);
+  vector<int> gap(folds);
+  for (int i = 0; i < n; i++)
+    if (gap[i] == 1)
+      gap[i] = 3;
+  REQUIRE_THROWS_AS(SAM::cv_grplasso(full, y.data(), gap, lambda, opt, cv), const std::invalid_argument&);
+}
+
+TEST_CASE("CV folds downdate the full-data Gram")
+{
+  int n = 200, d = 6, p = 3, K = 5, nlambda = 6;
+  vector<double> X, y;
+  make_problem(n, d, p, X, y);
+  vector<int> folds(n), train, test;
+  for (int i = 0; i < n; i++) {
+    folds[i] = i % K;
+    (folds[i] == 0 ? test : train).push_back(i);
+  }
+  SAM::DenseDesign full(X.data(), n, d, p);
+
+  // A downdated column equals the one computed on the training rows.
+  SAM::SharedGram<SAM::DenseDesign> shared(full);
+  SAM::RowSubsetDesign Xt(full, train.data(), train.size());
+  SAM::RowSubsetDesign Xout(full, test.data(), test.size());
+  SAM::GramDowndate<SAM::RowSubsetDesign> base = {[&shared](int j) { return shared.column(j); }, &Xout};
+  SAM::GramCache<SAM::RowSubsetDesign> direct(Xt), downdated(Xt, &base);
+  size_t m = (size_t)d * p;
+  for (int j = 0; j < d; j++) {
+    const double* a = direct.column(j);
+    const double* b = downdated.column(j);
+    for (size_t k = 0; k < m * p; k++)
+      REQUIRE(b[k] == Approx(a[k]).margin(1e-10));
+  }
+  REQUIRE(shared.cached() == d);
+
+  vector<double> lambda(nlambda);
+  for (int l = 0; l < nlambda; l++)
+    lambda[l] = std::pow(0.05, (double)l / (nlambda - 1));
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  opt.covariance = "on";
+  SAM::CVResult on, off;
+  SAM::cv_grplasso(full, y.data(), folds, lambda, opt, on);
+  opt.cv_gram = false;
+  SAM::cv_grplasso(full, y.data(), folds, lambda, opt, off);
+  REQUIRE(on.gram_columns > 0);
+  REQUIRE(off.gram_columns == 0);
+  for (size_t a = 0; a < on.fold_loss.size(); a++)
+    REQUIRE(on.fold_loss[a] == Approx(off.fold_loss[a]).epsilon(1e-8));
+  REQUIRE(on.index_min == off.index_min);
+}
+
+TEST_CASE("Successive-halving CV prunes clearly worse lambdas")
+{
+  int n = 240, d = 8, p = 3, K = 8, nlambda = 15;
+  vector<double> X, y;
+  make_problem(n, d, p, X, y);
+  vector<int> folds(n);
+  for (int i = 0; i < n; i++)
+    folds[i] = (i * 5) % K;
+  vector<double> lambda(nlambda);
+  for (int l = 0; l < nlambda; l++)
+    lambda[l] = std::pow(0.001, (double)l / (nlambda - 1));
+
+  SAM::DenseDesign full(X.data(), n, d, p);
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  SAM::CVResult plain, halving;
+  SAM::cv_grplasso(full, y.data(), folds, lambda, opt, plain);
+  SAM::cv_grplasso_halving(full, y.data(), folds, lambda, opt, 2, 2.0, halving);
+
+  REQUIRE(halving.round_folds == vector<int>({2, 4, 8}));
+  REQUIRE(plain.round_folds == vector<int>({K}));
+  int pruned = 0;
+  for (int l = 0; l < nlambda; l++) {
+    int used = halving.folds_used[l];
+    if (halving.pruned_round[l] >= 0) {
+      pruned++;
+      REQUIRE(used == halving.round_folds[halving.pruned_round[l]]);
+      REQUIRE(halving.prune_z[l] > 2.0);
+      REQUIRE(std::isnan(halving.fold_loss[(size_t)(K - 1) * nlambda + l]));
+    } else {
+      REQUIRE(used == K);
+    }
+    // Whatever was evaluated matches the full CV.
+    for (int f = 0; f < used; f++)
+      REQUIRE(halving.fold_loss[(size_t)f * nlambda + l] == Approx(plain.fold_loss[(size_t)f * nlambda + l]).epsilon(1e-6));
+  }
+  // lambda_max (all groups zero) is far worse than the best fit.
+  REQUIRE(halving.pruned_round[0] == 0);
+  REQUIRE(pruned < nlambda);
+  REQUIRE(halving.index_min == plain.index_min);
+  REQUIRE(halving.lambda_min == plain.lambda_min);
+
+  REQUIRE_THROWS_AS(SAM::cv_grplasso_halving(full, y.data(), folds, lambda, opt, 1, 2.0, halving), const std::invalid_argument&);
+}
@@ -0,0 +1,89 @@
+#include <catch.hpp>
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "kernels.h"
+
+using std::string;
+using std::vector;
+
+TEST_CASE("Every kernel variant matches the scalar loops")
+{
+  // Lengths around the unroll widths exercise the vector bodies and tails.
+  const int lens[] = {0, 1, 3, 4, 7, 8, 15, 16, 31, 32, 33, 100};
+  string initial = SAM::kernel_variant();
+  vector<string> variants = SAM::kernel_variants();
+  REQUIRE(variants.size() >= 2);
+  REQUIRE(variants[variants.size() - 2] == "scalar");
+  REQUIRE(variants.back() == "reproducible");
+  REQUIRE(SAM::select_kernels("auto") == variants.front());
+
+  for (const string& variant : variants) {
+    REQUIRE(SAM::select_kernels(variant) == variant);
+    for (int n : lens) {
+      vector<double> a(n), b(n), y(n), ref(n);
+      vector<float> f(n);
+      double ab = 0, aa = 0, fb = 0, ff = 0;
+      for (int i = 0; i < n; i++) {
+        a[i] = std::sin(1.3 * i + 0.2);
+        b[i] = std::cos(0.7 * i);
+        f[i] = (float)(0.5 - std::sin(2.1 * i));
+        y[i] = ref[i] = 0.25 * i;
+        ab += a[i] * b[i];
+        aa += a[i] * a[i];
+        fb += (double)f[i] * b[i];
+        ff += (double)f[i] * f[i];
+      }
+      REQUIRE(SAM::dot(a.data(), b.data(), n) == Approx(ab).margin(1e-12));
+      REQUIRE(SAM::sumsq(a.data(), n) == Approx(aa).margin(1e-12));
+      REQUIRE(SAM::dot(f.data(), b.data(), n) == Approx(fb).margin(1e-12));
+      REQUIRE(SAM::dot(f.data(), f.data(), n) == Approx(ff).margin(1e-12));
+
+      SAM::sub_scaled(1.5, a.data(), y.data(), n);
+      SAM::sub_scaled(-2.0, f.data(), y.data(), n);
+      for (int i = 0; i < n; i++)
+        REQUIRE(y[i] == Approx(ref[i] - 1.5 * a[i] + 2.0 * f[i]).margin(1e-12));
+
+      vector<double> z(n), delta(n);
+      double zn = SAM::group_step(a.data(), b.data(), 0.5, n, z.data());
+      double dd = SAM::group_delta(z.data(), b.data(), 0.3, n, delta.data());
+      double zz = 0, dref = 0;
+      for (int i = 0; i < n; i++) {
+        REQUIRE(z[i] == Approx(a[i] + 0.5 * b[i]).margin(1e-14));
+        REQUIRE(delta[i] == Approx(0.3 * z[i] - b[i]).margin(1e-14));
+        zz += z[i] * z[i];
+        dref += delta[i] * delta[i];
+      }
+      REQUIRE(zn == Approx(std::sqrt(zz)).margin(1e-12));
+      REQUIRE(dd == Approx(dref).margin(1e-12));
+    }
+  }
+
+  REQUIRE_THROWS_AS(SAM::select_kernels("sse9"), const std::invalid_argument&);
+  REQUIRE(SAM::kernel_variant() == "reproducible");
+  SAM::select_kernels(initial);
+}
+
+TEST_CASE("Reproducible kernels use one fixed summation order")
+{
+  string initial = SAM::kernel_variant();
+  REQUIRE(SAM::select_kernels("reproducible") == "reproducible");
+  for (int n : {5, 8, 37, 1000}) {
+    vector<double> a(n), b(n);
+    for (int i = 0; i < n; i++) {
+      a[i] = std::sin(0.37 * i) * 1e3;
+      b[i] = std::cos(1.1 * i) / 3;
+    }
+    // Eight lanes, element i in lane i % 8, lanes combined pairwise.
+    double lane[8] = {0};
+    for (int i = 0; i < n; i++) {
+      volatile double prod = a[i] * b[i];
+      lane[i % 8] += prod;
+    }
+    double ref = ((lane[0] + lane[1]) + (lane[2] + lane[3])) + ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+    REQUIRE(SAM::dot(a.data(), b.data(), n) == ref);
+  }
+  SAM::select_kernels(initial);
+}
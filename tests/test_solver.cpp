@@ -0,0 +1,658 @@
+#include <catch.hpp>
+
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "basis.h"
+#include "banded.h"
+#include "design.h"
+#include "gram.h"
+#include "kernels.h"
+#include "solver.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+using std::vector;
+
+// A small centered problem where only the first three of d groups matter.
+struct Problem {
+  int n, d, p;
+  vector<double> X, y;
+
+  Problem(int n, int d, int p) : n(n), d(d), p(p), X(n * d * p), y(n) {
+    unsigned seed = 12345;
+    for (size_t a = 0; a < X.size(); a++) {
+      seed = seed * 1103515245 + 12345;
+      X[a] = ((seed >> 8) % 2000) / 1000.0 - 1;
+    }
+    for (int c = 0; c < d * p; c++) {
+      double mean = 0;
+      for (int i = 0; i < n; i++)
+        mean += X[c * n + i] / n;
+      for (int i = 0; i < n; i++)
+        X[c * n + i] -= mean;
+    }
+    double mean = 0;
+    for (int i = 0; i < n; i++) {
+      y[i] = std::sin(0.05 * i);
+      for (int j = 0; j < 3; j++)
+        for (int k = 0; k < p; k++)
+          y[i] += (k + 1.0) / (j + 1) * X[(j * p + k) * n + i];
+      mean += y[i] / n;
+    }
+    for (int i = 0; i < n; i++)
+      y[i] -= mean;
+  }
+};
+
+static vector<double> ratios(int nlambda) {
+  vector<double> lambda(nlambda);
+  for (int l = 0; l < nlambda; l++)
+    lambda[l] = std::pow(0.05, (double)l / (nlambda - 1));
+  return lambda;
+}
+
+TEST_CASE("Strong rules give the unscreened path and satisfy KKT")
+{
+  Problem P(120, 40, 4);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-9;
+  opt.max_ite = 100000;
+
+  SAM::PathResult screened, full;
+  SAM::grplasso_path(X, P.y.data(), ratios(20), opt, ws, screened);
+  opt.screening = "none";
+  SAM::grplasso_path(X, P.y.data(), ratios(20), opt, ws, full);
+
+  for (size_t a = 0; a < full.w.size(); a++)
+    REQUIRE(screened.w[a] == Approx(full.w[a]).margin(1e-6));
+  REQUIRE(screened.df == full.df);
+  REQUIRE(screened.strong_set[0] < P.d);
+
+  // KKT at the last lambda: ||X_j^T r|| / n <= lambda for zero groups and
+  // X_j^T r / n = lambda w_j / ||w_j|| otherwise.
+  int l = screened.nlambda - 1;
+  double lam = screened.lambda[l];
+  const double* w = &screened.w[l * P.d * P.p];
+  vector<double> r(P.y), g(P.p);
+  for (int j = 0; j < P.d; j++)
+    X.axpy(j, w + j * P.p, r.data());
+  for (int j = 0; j < P.d; j++) {
+    X.xtr(j, r.data(), g.data());
+    double wn = SAM::calc_norm(w + j * P.p, P.p);
+    if (wn == 0) {
+      REQUIRE(SAM::calc_norm(g.data(), P.p) / P.n <= lam * (1 + 1e-6));
+    } else {
+      for (int k = 0; k < P.p; k++)
+        REQUIRE(g[k] / P.n == Approx(lam * w[j * P.p + k] / wn).margin(1e-6));
+    }
+  }
+}
+
+TEST_CASE("Gap-safe screening stops on the duality gap")
+{
+  Problem P(120, 40, 4);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  opt.max_ite = 100000;
+
+  SAM::PathResult safe, strong;
+  SAM::grplasso_path(X, P.y.data(), ratios(15), opt, ws, strong);
+  opt.screening = "gap_safe";
+  SAM::grplasso_path(X, P.y.data(), ratios(15), opt, ws, safe);
+
+  double null_obj = 0;
+  for (int i = 0; i < P.n; i++)
+    null_obj += P.y[i] * P.y[i] / (2 * P.n);
+  for (int l = 0; l < safe.nlambda; l++) {
+    REQUIRE(safe.gap[l] <= opt.thol * null_obj);
+    REQUIRE(safe.df[l] == strong.df[l]);
+    REQUIRE(safe.safe_set[l] >= safe.df[l]);
+  }
+  REQUIRE(safe.safe_set[0] < P.d);
+  for (size_t a = 0; a < safe.w.size(); a++)
+    REQUIRE(safe.w[a] == Approx(strong.w[a]).margin(1e-5));
+
+  opt.regfunc = "MCP";
+  SAM::PathResult out;
+  REQUIRE_THROWS(SAM::grplasso_path(X, P.y.data(), ratios(15), opt, ws, out));
+}
+
+TEST_CASE("Working-set solver reaches the same path")
+{
+  Problem P(80, 200, 3);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  opt.max_ite = 100000;
+
+  SAM::PathResult ref;
+  SAM::grplasso_path(X, P.y.data(), ratios(10), opt, ws, ref);
+  opt.working_set = true;
+  const char* modes[] = {"none", "gap_safe"};
+  for (const char* mode : modes) {
+    opt.screening = mode;
+    SAM::PathResult out;
+    SAM::grplasso_path(X, P.y.data(), ratios(10), opt, ws, out);
+    // At lambda_max itself the largest group may be left at round-off size.
+    for (int l = 1; l < out.nlambda; l++)
+      REQUIRE(out.df[l] == ref.df[l]);
+    REQUIRE(out.working_set[1] < P.d);
+    for (size_t a = 0; a < out.w.size(); a++)
+      REQUIRE(out.w[a] == Approx(ref.w[a]).margin(1e-5));
+  }
+
+  opt.screening = "none";
+  opt.regfunc = "MCP";
+  opt.working_set = false;
+  SAM::PathResult mcp, mcp_ws;
+  SAM::grplasso_path(X, P.y.data(), ratios(10), opt, ws, mcp);
+  opt.working_set = true;
+  SAM::grplasso_path(X, P.y.data(), ratios(10), opt, ws, mcp_ws);
+  for (int l = 1; l < mcp.nlambda; l++)
+    REQUIRE(mcp_ws.df[l] == mcp.df[l]);
+}
+
+TEST_CASE("Covariance updates follow the residual path")
+{
+  Problem P(400, 12, 3);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  opt.max_ite = 100000;
+  REQUIRE(SAM::use_covariance(P.n, P.d, P.p));
+
+  const char* modes[] = {"strong", "gap_safe"};
+  for (const char* mode : modes)
+    for (int ortho = 0; ortho < 2; ortho++) {
+      opt.screening = mode;
+      opt.orthonormalize = ortho;
+      SAM::PathResult cov, res;
+      opt.covariance = "on";
+      SAM::grplasso_path(X, P.y.data(), ratios(12), opt, ws, cov);
+      opt.covariance = "off";
+      SAM::grplasso_path(X, P.y.data(), ratios(12), opt, ws, res);
+      REQUIRE(cov.gram_cached[11] >= cov.df[11]);
+      REQUIRE(cov.gram_cached[11] <= P.d);
+      for (int l = 0; l < cov.nlambda; l++) {
+        REQUIRE(cov.sse[l] == Approx(res.sse[l]).epsilon(1e-8));
+        for (int j = 0; j < P.d; j++)
+          REQUIRE(cov.func_norm[l * P.d + j] == Approx(res.func_norm[l * P.d + j]).margin(1e-8));
+      }
+      for (size_t a = 0; a < cov.w.size(); a++)
+        REQUIRE(cov.w[a] == Approx(res.w[a]).margin(1e-6));
+    }
+}
+
+TEST_CASE("Non-convex penalties")
+{
+  Problem P(100, 10, 3);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  const char* pens[] = {"MCP", "SCAD"};
+  for (const char* pen : pens) {
+    opt.regfunc = pen;
+    SAM::PathResult out;
+    SAM::grplasso_path(X, P.y.data(), ratios(10), opt, ws, out);
+    REQUIRE(out.df[0] == 0);
+    REQUIRE(out.df[9] >= 3);
+    REQUIRE(out.sse[9] < out.sse[0]);
+  }
+}
+
+TEST_CASE("Orthonormalized spline groups")
+{
+  const int n = 300, d = 4, p = 6, degree = 3, nknots = p + degree + 1;
+  vector<double> x(n * d), y(n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < d; j++)
+      x[j * n + i] = std::sin(0.7 * i + j) + 0.1 * j;
+    y[i] = 2 + x[i] * x[i] + std::cos(3 * x[n + i]) + 0.01 * std::sin(11.0 * i);
+  }
+  vector<double> knots(d * nknots), XX(n * d * p);
+  SAM::bspline_knots(x.data(), n, d, p, degree, knots.data());
+  SAM::bspline_basis(x.data(), n, d, knots.data(), nknots, degree, XX.data());
+  SAM::DenseDesign X(XX.data(), n, d, p);
+  SAM::BandedDesign B;
+  SAM::bspline_banded(x.data(), n, d, knots.data(), nknots, degree, B);
+
+  // Centered B-splines sum to zero, so each group loses one direction.
+  SAM::GroupTransform tf;
+  tf.fit(X, true);
+  SAM::OrthoDesign<SAM::DenseDesign> O(X, tf);
+  vector<double> G(p * p);
+  for (int j = 0; j < d; j++) {
+    REQUIRE(tf.rank[j] == p - 1);
+    O.gram(j, G.data());
+    double trace = 0;
+    for (int k = 0; k < p; k++)
+      trace += G[k * p + k] / n;
+    REQUIRE(trace == Approx(p - 1));
+  }
+
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  opt.max_ite = 100000;
+  opt.orthonormalize = true;
+  SAM::PathResult dense, banded;
+  SAM::grplasso_path(X, y.data(), ratios(8), opt, ws, dense);
+  SAM::grplasso_path(B, y.data(), ratios(8), opt, ws, banded, &tf);
+  REQUIRE(dense.df[7] >= 2);
+  for (size_t a = 0; a < dense.w.size(); a++)
+    REQUIRE(banded.w[a] == Approx(dense.w[a]).margin(1e-6));
+
+  // The coefficients come back in the original basis with an intercept.
+  for (int l = 0; l < dense.nlambda; l++) {
+    vector<double> r(y);
+    for (int i = 0; i < n; i++)
+      r[i] -= dense.intercept[l];
+    for (int j = 0; j < d; j++)
+      X.axpy(j, &dense.w[(l * d + j) * p], r.data());
+    double sse = 0;
+    for (int i = 0; i < n; i++)
+      sse += r[i] * r[i];
+    REQUIRE(sse == Approx(dense.sse[l]).epsilon(1e-6));
+  }
+}
+
+TEST_CASE("Single-precision design storage")
+{
+  // Accumulation is double, so a float design solves the same problem as a
+  // double design holding the same (rounded) values.
+  Problem P(150, 20, 4);
+  vector<float> Xf(P.X.begin(), P.X.end());
+  vector<double> Xr(Xf.begin(), Xf.end());
+  SAM::DenseDesignF F(Xf.data(), P.n, P.d, P.p);
+  SAM::DenseDesign D(Xr.data(), P.n, P.d, P.p);
+  SAM::GrpLassoWorkspace ws;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-10;
+  opt.max_ite = 100000;
+  SAM::PathResult single, dbl;
+  SAM::grplasso_path(F, P.y.data(), ratios(10), opt, ws, single);
+  SAM::grplasso_path(D, P.y.data(), ratios(10), opt, ws, dbl);
+  REQUIRE(single.df == dbl.df);
+  for (size_t a = 0; a < dbl.w.size(); a++)
+    REQUIRE(single.w[a] == Approx(dbl.w[a]).margin(1e-8));
+
+  const int n = 200, d = 3, p = 5, degree = 3, nknots = p + degree + 1;
+  vector<double> x(n * d), y(n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < d; j++)
+      x[j * n + i] = std::cos(0.3 * i + 2 * j);
+    y[i] = x[i] * x[i] - x[n + i];
+  }
+  vector<double> knots(d * nknots);
+  SAM::bspline_knots(x.data(), n, d, p, degree, knots.data());
+  SAM::BandedDesign B;
+  SAM::BandedDesignF BF;
+  SAM::bspline_banded(x.data(), n, d, knots.data(), nknots, degree, B);
+  SAM::bspline_banded(x.data(), n, d, knots.data(), nknots, degree, BF);
+  REQUIRE(BF.nbytes() < B.nbytes());
+  vector<float> XF(n * d * p);
+  SAM::bspline_basis(x.data(), n, d, knots.data(), nknots, degree, XF.data());
+  opt.orthonormalize = true;
+  SAM::PathResult banded, banded_f, dense_f;
+  SAM::grplasso_path(B, y.data(), ratios(8), opt, ws, banded);
+  SAM::grplasso_path(BF, y.data(), ratios(8), opt, ws, banded_f);
+  SAM::grplasso_path(SAM::DenseDesignF(XF.data(), n, d, p), y.data(), ratios(8), opt, ws, dense_f);
+  for (size_t a = 0; a < banded.w.size(); a++) {
+    REQUIRE(banded_f.w[a] == Approx(banded.w[a]).margin(1e-4));
+    REQUIRE(dense_f.w[a] == Approx(banded_f.w[a]).margin(1e-8));
+  }
+}
+
+TEST_CASE("Group-size specialized solvers match the generic one")
+{
+  const int sizes[] = {3, 4, 7, 8};
+  for (int p : sizes) {
+    Problem P(120, 15, p);
+    SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+    SAM::GrpLassoWorkspace ws;
+    SAM::SolverOptions opt;
+    opt.lambda_input = 0;
+    opt.thol = 1e-10;
+    opt.max_ite = 100000;
+    const char* pens[] = {"L1", "MCP"};
+    for (const char* pen : pens)
+      for (int cov = 0; cov < 2; cov++) {
+        opt.regfunc = pen;
+        opt.covariance = cov ? "on" : "off";
+        SAM::PathResult fixed, generic;
+        opt.specialize = true;
+        SAM::grplasso_path(X, P.y.data(), ratios(8), opt, ws, fixed);
+        opt.specialize = false;
+        SAM::grplasso_path(X, P.y.data(), ratios(8), opt, ws, generic);
+        REQUIRE(fixed.df == generic.df);
+        for (size_t a = 0; a < fixed.w.size(); a++)
+          REQUIRE(fixed.w[a] == Approx(generic.w[a]).margin(1e-8));
+      }
+  }
+}
+
+TEST_CASE("Padded column stride")
+{
+  Problem P(101, 12, 3);
+  int ld = SAM::padded_stride(P.n, sizeof(double));
+  REQUIRE(ld == 104);
+  REQUIRE(SAM::padded_stride(P.n, sizeof(float)) == 112);
+
+  SAM::GrpLassoWorkspace ws, single;
+  single.reserve(P.n, P.d, P.p, true, true);
+  REQUIRE(single.compatible(P.n, P.d, P.p, true));
+  REQUIRE(!single.compatible(P.n, P.d, P.p));
+  ws.reserve(P.n, P.d, P.p);
+  REQUIRE(ws.compatible(P.n, P.d, P.p, true));
+  double* buf = ws.design();
+  for (int c = 0; c < P.d * P.p; c++)
+    for (int i = 0; i < ld; i++)
+      buf[(size_t)c * ld + i] = i < P.n ? P.X[(size_t)c * P.n + i] : 1e300;
+  SAM::DenseDesign padded(buf, P.n, P.d, P.p, ld);
+  SAM::DenseDesign packed(P.X.data(), P.n, P.d, P.p);
+  REQUIRE(padded.aligned());
+
+  SAM::GrpLassoWorkspace scratch;
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  SAM::PathResult a, b;
+  SAM::grplasso_path(padded, P.y.data(), ratios(6), opt, scratch, a);
+  SAM::grplasso_path(packed, P.y.data(), ratios(6), opt, scratch, b);
+  REQUIRE(a.df == b.df);
+  for (size_t k = 0; k < a.w.size(); k++)
+    REQUIRE(a.w[k] == Approx(b.w[k]).margin(1e-10));
+}
+
+TEST_CASE("Concurrent fits on separate workspaces")
+{
+  Problem P(150, 20, 4);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+
+  SAM::GrpLassoWorkspace ws;
+  SAM::PathResult serial;
+  SAM::grplasso_path(X, P.y.data(), ratios(8), opt, ws, serial);
+
+  // A workspace serves one fit at a time.
+  REQUIRE(ws.try_acquire());
+  REQUIRE_FALSE(ws.try_acquire());
+  ws.release();
+  REQUIRE(ws.try_acquire());
+  ws.release();
+
+  const int nfits = 4;
+  vector<SAM::GrpLassoWorkspace> spaces(nfits);
+  vector<SAM::PathResult> results(nfits);
+  vector<std::thread> threads;
+  for (int t = 0; t < nfits; t++)
+    threads.push_back(std::thread([&, t]() {
+      SAM::grplasso_path(X, P.y.data(), ratios(8), opt, spaces[t], results[t]);
+    }));
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+
+  for (int t = 0; t < nfits; t++) {
+    REQUIRE(results[t].df == serial.df);
+    REQUIRE(results[t].w == serial.w);
+  }
+}
+
+TEST_CASE("Parallel block updates reach the serial fixed point")
+{
+  Problem P(120, 300, 4);
+  // Neighbouring groups share most of their columns in the second design,
+  // so concurrent updates of a batch conflict.
+  vector<double> Xc(P.X);
+  for (int j = 1; j < P.d; j++)
+    for (size_t a = 0; a < (size_t)P.p * P.n; a++)
+      Xc[(size_t)j * P.p * P.n + a] = 0.9 * Xc[(size_t)(j - 1) * P.p * P.n + a] + 0.1 * P.X[(size_t)j * P.p * P.n + a];
+
+  const vector<double>* designs[] = {&P.X, &Xc};
+  for (const vector<double>* Xd : designs) {
+    SAM::DenseDesign X(Xd->data(), P.n, P.d, P.p);
+    SAM::SolverOptions opt;
+    opt.lambda_input = 0;
+    opt.thol = 1e-9;
+    opt.covariance = "off";
+    SAM::GrpLassoWorkspace ws;
+    SAM::PathResult serial, parallel;
+    SAM::grplasso_path(X, P.y.data(), ratios(6), opt, ws, serial);
+    opt.parallel_cd = true;
+    SAM::grplasso_path(X, P.y.data(), ratios(6), opt, ws, parallel);
+
+    for (int l = 0; l < 6; l++)
+      REQUIRE(parallel.sse[l] == Approx(serial.sse[l]).epsilon(1e-6));
+    for (size_t k = 0; k < serial.w.size(); k++)
+      REQUIRE(parallel.w[k] == Approx(serial.w[k]).margin(1e-5));
+  }
+}
+
+TEST_CASE("Fits do not depend on the thread count")
+{
+  // Large enough that full passes and parallel batches use the pool.
+  Problem P(200, 120, 4);
+  SAM::DenseDesign X(P.X.data(), P.n, P.d, P.p);
+  int initial_threads = SAM::get_num_threads();
+  string initial_kernels = SAM::kernel_variant();
+
+  const char* kernels[] = {"auto", "reproducible"};
+  for (const char* variant : kernels) {
+    SAM::select_kernels(variant);
+    for (int mode = 0; mode < 3; mode++) {
+      SAM::SolverOptions opt;
+      opt.lambda_input = 0;
+      opt.covariance = "off";
+      opt.parallel_cd = mode == 1;
+      if (mode == 2)
+        opt.screening = "gap_safe";
+
+      SAM::PathResult ref;
+      const int counts[] = {1, 2, 3, 8};
+      for (int nthreads : counts) {
+        SAM::set_num_threads(nthreads);
+        SAM::GrpLassoWorkspace ws;
+        SAM::PathResult out;
+        SAM::grplasso_path(X, P.y.data(), ratios(8), opt, ws, out);
+        if (nthreads == 1) {
+          ref = out;
+          continue;
+        }
+        REQUIRE(out.w == ref.w);
+        REQUIRE(out.sse == ref.sse);
+        REQUIRE(out.iterations == ref.iterations);
+        REQUIRE(out.gap == ref.gap);
+      }
+    }
+  }
+
+  SAM::set_num_threads(initial_threads);
+  SAM::select_kernels(initial_kernels);
+}
+
+TEST_CASE("Approximate leave-one-out risk")
+{
+  Problem P(60, 5, 3);
+  int n = P.n, m = P.d * P.p;
+  SAM::DenseDesign X(P.X.data(), n, P.d, P.p);
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-12;
+  opt.max_ite = 100000;
+  opt.alo = true;
+  vector<double> lambda = {1, 0.3, 0.1, 1e-7};
+  SAM::GrpLassoWorkspace ws;
+  SAM::PathResult out;
+  SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, out);
+
+  // Without a penalty ALO is the exact PRESS of least squares with an
+  // intercept.
+  Eigen::Map<const Eigen::MatrixXd> A(P.X.data(), n, m);
+  Eigen::Map<const Eigen::VectorXd> y(P.y.data(), n);
+  Eigen::MatrixXd H = A * (A.transpose() * A).ldlt().solve(A.transpose());
+  Eigen::VectorXd e = y - H * y;
+  double press = 0;
+  for (int i = 0; i < n; i++)
+    press += std::pow(e[i] / (1 - H(i, i) - 1.0 / n), 2) / n;
+  REQUIRE(out.alo[3] == Approx(press).epsilon(1e-4));
+
+  // With the penalty active it tracks brute-force leave-one-out refits.
+  for (int l = 0; l < 3; l++) {
+    SAM::SolverOptions fixed = opt;
+    fixed.lambda_input = 1;
+    fixed.alo = false;
+    double loo = 0;
+    for (int i = 0; i < n; i++) {
+      vector<int> rows;
+      for (int a = 0; a < n; a++)
+        if (a != i)
+          rows.push_back(a);
+      vector<double> Xi((size_t)(n - 1) * m), yi(n - 1), mean(m, 0.0);
+      double ybar = 0;
+      for (int a = 0; a < n - 1; a++)
+        ybar += P.y[rows[a]] / (n - 1);
+      for (int c = 0; c < m; c++) {
+        for (int a = 0; a < n - 1; a++)
+          mean[c] += P.X[(size_t)c * n + rows[a]] / (n - 1);
+        for (int a = 0; a < n - 1; a++)
+          Xi[(size_t)c * (n - 1) + a] = P.X[(size_t)c * n + rows[a]] - mean[c];
+      }
+      for (int a = 0; a < n - 1; a++)
+        yi[a] = P.y[rows[a]] - ybar;
+      SAM::PathResult fit;
+      SAM::grplasso_path(SAM::DenseDesign(Xi.data(), n - 1, P.d, P.p), yi.data(), vector<double>(1, out.lambda[l]), fixed, ws, fit);
+      double pred = ybar;
+      for (int c = 0; c < m; c++)
+        pred += (P.X[(size_t)c * n + i] - mean[c]) * fit.w[c];
+      loo += (P.y[i] - pred) * (P.y[i] - pred) / n;
+    }
+    INFO("lambda " << l << " alo " << out.alo[l] << " loo " << loo);
+    REQUIRE(out.alo[l] == Approx(loo).epsilon(0.05));
+  }
+
+  // With more coefficients than rows the lasso fit saturates (h_ii + 1/n
+  // -> 1), but its residuals vanish as fast and the estimate stays finite.
+  Problem S(8, 3, 3);
+  SAM::PathResult sat;
+  SAM::grplasso_path(SAM::DenseDesign(S.X.data(), S.n, S.d, S.p), S.y.data(), lambda, opt, ws, sat);
+  REQUIRE(sat.df[3] == S.d);
+  REQUIRE(std::isfinite(sat.alo[3]));
+  REQUIRE(sat.alo[3] > 0);
+
+  opt.alo = false;
+  SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, out);
+  REQUIRE(std::isnan(out.alo[0]));
+}
+
+TEST_CASE("Effective degrees of freedom and information criteria")
+{
+  Problem P(80, 12, 3);
+  int n = P.n, d = P.d;
+  SAM::DenseDesign X(P.X.data(), n, d, P.p);
+  SAM::SolverOptions opt;
+  opt.lambda_input = 0;
+  opt.thol = 1e-12;
+  opt.max_ite = 100000;
+  opt.criteria = "exact";
+  vector<double> lambda = {1, 0.3, 0.1, 0.03, 1e-7};
+  SAM::GrpLassoWorkspace ws;
+  SAM::PathResult exact, probed;
+  SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, exact);
+  opt.criteria = "hutchinson";
+  SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, probed);
+
+  // Nothing is active at lambda_max; near lambda = 0 the fit is least squares
+  // on all d p coefficients, up to the slight shrinkage left in the groups.
+  REQUIRE(exact.edf[0] == Approx(0).margin(1e-12));
+  REQUIRE(exact.edf[4] == Approx(d * P.p).epsilon(1e-4));
+  for (int l = 0; l < (int)lambda.size(); l++) {
+    INFO("lambda " << l << " exact " << exact.edf[l] << " hutchinson " << probed.edf[l]);
+    REQUIRE(exact.edf[l] <= exact.df[l] * P.p + 1e-8);
+    REQUIRE(probed.edf[l] == Approx(exact.edf[l]).epsilon(0.15).margin(1e-8));
+    double k = exact.edf[l] + 1, fit = n * std::log(exact.sse[l] / n);
+    REQUIRE(exact.gcv[l] == Approx(exact.sse[l] / n / std::pow(1 - k / n, 2)));
+    REQUIRE(exact.aic[l] == Approx(fit + 2 * k));
+    REQUIRE(exact.bic[l] == Approx(fit + std::log((double)n) * k));
+    double choose = 1;
+    for (int j = 0; j < exact.df[l]; j++)
+      choose *= double(d - j) / (j + 1);
+    REQUIRE(exact.ebic[l] == Approx(exact.bic[l] + 2 * opt.ebic_gamma * std::log(choose)));
+  }
+
+  // auto takes the exact trace for small active sets.
+  opt.criteria = "auto";
+  SAM::PathResult picked;
+  SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, picked);
+  REQUIRE(picked.edf[2] == Approx(exact.edf[2]).epsilon(1e-10));
+
+  opt.criteria = "off";
+  SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, picked);
+  REQUIRE(std::isnan(picked.edf[0]));
+  REQUIRE(std::isnan(picked.ebic[0]));
+  // An interpolating fit has no finite likelihood: the log-based criteria
+  // are NaN, GCV is still defined.
+  opt.criteria = "exact";
+  opt.lambda_input = 1;
+  vector<double> zero(n, 0.0);
+  SAM::grplasso_path(X, zero.data(), vector<double>(1, 0.1), opt, ws, picked);
+  REQUIRE(picked.sse[0] == 0);
+  REQUIRE(picked.gcv[0] == 0);
+  REQUIRE(std::isnan(picked.aic[0]));
+  REQUIRE(std::isnan(picked.bic[0]));
+  REQUIRE(std::isnan(picked.ebic[0]));
+
+  opt.criteria = "bogus";
+  REQUIRE_THROWS_AS(SAM::grplasso_path(X, P.y.data(), lambda, opt, ws, picked), const std::invalid_argument&);
+  REQUIRE_THROWS_AS(SAM::parse_criteria("bogus"), const std::invalid_argument&);
+  REQUIRE(SAM::parse_criteria("hutchinson") == SAM::CRITERIA_HUTCHINSON);
+}
+
+TEST_CASE("Criteria of an MCP fit in the concave region")
+{
+  // Two correlated one-column groups, started at the MCP stationary point
+  // (G - I/gamma) w = X^T y / n - lambda with both in the concave region.
+  // There the smoother's M is indefinite: neither trace is defined.
+  Problem P(50, 2, 1);
+  int n = P.n;
+  for (int i = 0; i < n; i++) {
+    P.X[n + i] = 2 * (P.X[i] + 0.3 * P.X[n + i]);
+    P.X[i] *= 2;
+  }
+  Eigen::Map<const Eigen::MatrixXd> A(P.X.data(), n, 2);
+  Eigen::VectorXd y = 0.5 * (A.col(0) + A.col(1));
+  double gamma = 3, lambda = 0.4;
+  Eigen::Matrix2d G = A.transpose() * A / n;
+  Eigen::Vector2d w = (G - Eigen::Matrix2d::Identity() / gamma).lu().solve(A.transpose() * y / n - Eigen::Vector2d::Constant(lambda));
+  REQUIRE(w.minCoeff() > 0);
+  REQUIRE(w.maxCoeff() < gamma * lambda);
+
+  SAM::DenseDesign X(P.X.data(), n, 2, 1);
+  SAM::SolverOptions opt;
+  opt.regfunc = "MCP";
+  opt.gamma = gamma;
+  SAM::GrpLassoWorkspace ws;
+  const char* modes[] = {"exact", "hutchinson"};
+  for (const char* mode : modes) {
+    opt.criteria = mode;
+    SAM::PathResult out;
+    SAM::grplasso_path(X, y.data(), vector<double>(1, lambda), opt, ws, out, NULL, w.data());
+    REQUIRE(out.w[0] == Approx(w[0]).margin(1e-8));
+    REQUIRE(out.w[1] == Approx(w[1]).margin(1e-8));
+    REQUIRE(std::isnan(out.edf[0]));
+    REQUIRE(std::isnan(out.gcv[0]));
+  }
+}
@@ -0,0 +1,43 @@
+#include <catch.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include "thread_pool.h"
+
+using std::vector;
+
+TEST_CASE("Shared thread pool")
+{
+  int initial = SAM::get_num_threads();
+  REQUIRE(initial >= 1);
+
+  const int counts[] = {1, 3, 8};
+  for (int nthreads : counts) {
+    SAM::set_num_threads(nthreads);
+    REQUIRE(SAM::get_num_threads() == nthreads);
+
+    // Every index runs exactly once, whatever the grain.
+    for (int grain = 1; grain <= 7; grain += 3) {
+      vector<int> hits(1000, 0);
+      SAM::parallel_for(hits.size(), [&](int i) { hits[i]++; }, grain);
+      for (int h : hits)
+        REQUIRE(h == 1);
+    }
+
+    // Nested calls run inline on the calling worker.
+    std::atomic<int> total(0);
+    SAM::parallel_for(10, [&](int) {
+      SAM::parallel_for(10, [&](int) { total++; });
+    });
+    REQUIRE(total == 100);
+
+    REQUIRE_THROWS_AS(SAM::parallel_for(100, [](int i) {
+      if (i == 42)
+        throw std::runtime_error("task failed");
+    }), const std::runtime_error&);
+  }
+
+  SAM::set_num_threads(0);
+  SAM::set_num_threads(initial);
+}